@@ -1,14 +1,20 @@
-// Using SDL, SDL_image, standard IO, and strings
+// Using SDL, SDL_image, standard IO, strings, maps, vectors, and sorting
 #include <SDL.h>
 #include <SDL_image.h>
 #include <stdio.h>
 #include <string>
 #include <cmath>
+#include <map>
+#include <vector>
+#include <algorithm>
 
 // Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+//Empty pixels between packed atlas images so linear filtering doesn't bleed
+const int ATLAS_PADDING = 1;
+
 //Texture wrapper class
 class LTexture
 {
@@ -22,6 +28,9 @@ class LTexture
     //Loads image at specified path
     bool loadFromFile( std::string path );
 
+    //Creates image from surface pixels
+    bool loadFromSurface( SDL_Surface* surface );
+
 #if defined(SDL_TTF_MAJOR_VERSION)
     //Creates image from font string
     bool loadFromRenderedText( std::string textureText, SDL_Color textColor );
@@ -55,6 +64,36 @@ class LTexture
     int mHeight;
 };
 
+//Several images packed into one texture
+class LTextureAtlas
+{
+  public:
+    //Initialize variables
+    LTextureAtlas();
+
+    //Deallocate memory
+    ~LTextureAtlas();
+
+    //Packs images at specified paths into a texture no wider than maxWidth
+    bool loadFromFiles( std::vector<std::string> paths, int maxWidth = 1024 );
+
+    //Deallocate atlas
+    void free();
+
+    //Gets the region an image was packed into
+    SDL_Rect* getClip( std::string path );
+
+    //Gets the packed texture
+    LTexture* getTexture();
+
+  private:
+    //The packed texture
+    LTexture mTexture;
+
+    //Packed regions by image path
+    std::map<std::string, SDL_Rect> mClips;
+};
+
 // The window we'll be rendering to
 SDL_Window *gWindow = NULL;
 
@@ -63,11 +102,14 @@ SDL_Renderer *gRenderer = NULL;
 
 
 //Scene textures
-LTexture gPressTexture;
-LTexture gUpTexture;
-LTexture gDownTexture;
-LTexture gLeftTexture;
-LTexture gRightTexture;
+LTextureAtlas gKeyAtlas;
+
+//Key press regions in the atlas
+SDL_Rect* gPressClip = NULL;
+SDL_Rect* gUpClip = NULL;
+SDL_Rect* gDownClip = NULL;
+SDL_Rect* gLeftClip = NULL;
+SDL_Rect* gRightClip = NULL;
 
 
 LTexture::LTexture()
@@ -125,6 +167,28 @@ bool LTexture::loadFromFile( std::string path )
   return mTexture != NULL;
 }
 
+bool LTexture::loadFromSurface( SDL_Surface* surface )
+{
+  //Get rid of preexisting texture
+  free();
+
+  //Create texture from surface pixels
+  mTexture = SDL_CreateTextureFromSurface( gRenderer, surface );
+  if( mTexture == NULL )
+  {
+    printf( "Unable to create texture from surface! SDL Error: %s\n", SDL_GetError() );
+  }
+  else
+  {
+    //Get image dimensions
+    mWidth = surface->w;
+    mHeight = surface->h;
+  }
+
+  //Return success
+  return mTexture != NULL;
+}
+
 #if defined( SDL_TTF_MAJOR_VERSION )
 bool LTexture::loadFromRenderedText( std::string textureText, SDL_Color textColor )
 {
@@ -215,6 +279,158 @@ int LTexture::getHeight()
   return mHeight;
 }
 
+LTextureAtlas::LTextureAtlas()
+{
+}
+
+LTextureAtlas::~LTextureAtlas()
+{
+  //Deallocate
+  free();
+}
+
+bool LTextureAtlas::loadFromFiles( std::vector<std::string> paths, int maxWidth )
+{
+  //Get rid of preexisting atlas
+  free();
+
+  //Loading success flag
+  bool success = true;
+
+  //Load every image
+  std::vector<SDL_Surface*> surfaces( paths.size(), (SDL_Surface*)NULL );
+  for( size_t i = 0; i < paths.size(); ++i )
+  {
+    surfaces[ i ] = IMG_Load( paths[ i ].c_str() );
+    if( surfaces[ i ] == NULL )
+    {
+      printf( "Unable to load image %s! SDL_image Error: %s\n", paths[ i ].c_str(), IMG_GetError() );
+      success = false;
+    }
+    else
+    {
+      //Color key image and copy its pixels as they are
+      SDL_SetColorKey( surfaces[ i ], SDL_TRUE, SDL_MapRGB( surfaces[ i ]->format, 0, 0xFF, 0xFF ) );
+      SDL_SetSurfaceBlendMode( surfaces[ i ], SDL_BLENDMODE_NONE );
+    }
+  }
+
+  if( success )
+  {
+    //Pack tallest images first so each shelf wastes little height
+    std::vector<size_t> order( paths.size() );
+    for( size_t i = 0; i < order.size(); ++i )
+    {
+      order[ i ] = i;
+    }
+    std::sort( order.begin(), order.end(), [ &surfaces ]( size_t a, size_t b ) { return surfaces[ a ]->h > surfaces[ b ]->h; } );
+
+    //Place images left to right on shelves, starting a new shelf when a row fills up
+    int shelfX = 0;
+    int shelfY = 0;
+    int shelfHeight = 0;
+    int atlasWidth = 0;
+    for( size_t i = 0; i < order.size() && success; ++i )
+    {
+      SDL_Surface* surface = surfaces[ order[ i ] ];
+
+      //Skip images requested more than once
+      if( mClips.find( paths[ order[ i ] ] ) != mClips.end() )
+      {
+        continue;
+      }
+
+      if( surface->w > maxWidth )
+      {
+        printf( "Image %s is wider than the atlas!\n", paths[ order[ i ] ].c_str() );
+        success = false;
+      }
+      else
+      {
+        //Go to the next shelf
+        if( shelfX + surface->w > maxWidth )
+        {
+          shelfX = 0;
+          shelfY += shelfHeight + ATLAS_PADDING;
+          shelfHeight = 0;
+        }
+
+        //Set the image region
+        SDL_Rect clip = { shelfX, shelfY, surface->w, surface->h };
+        mClips[ paths[ order[ i ] ] ] = clip;
+
+        //Move along the shelf
+        shelfX += surface->w + ATLAS_PADDING;
+        shelfHeight = std::max( shelfHeight, surface->h );
+        atlasWidth = std::max( atlasWidth, shelfX );
+      }
+    }
+
+    if( success )
+    {
+      //Copy images into one transparent surface
+      SDL_Surface* atlasSurface = SDL_CreateRGBSurfaceWithFormat( 0, atlasWidth, shelfY + shelfHeight, 32, SDL_PIXELFORMAT_RGBA8888 );
+      if( atlasSurface == NULL )
+      {
+        printf( "Unable to create atlas surface! SDL Error: %s\n", SDL_GetError() );
+        success = false;
+      }
+      else
+      {
+        for( size_t i = 0; i < paths.size(); ++i )
+        {
+          SDL_Rect destination = mClips[ paths[ i ] ];
+          SDL_BlitSurface( surfaces[ i ], NULL, atlasSurface, &destination );
+        }
+
+        //Upload the packed images once
+        success = mTexture.loadFromSurface( atlasSurface );
+        SDL_FreeSurface( atlasSurface );
+      }
+    }
+  }
+
+  //Get rid of loaded surfaces
+  for( size_t i = 0; i < surfaces.size(); ++i )
+  {
+    if( surfaces[ i ] != NULL )
+    {
+      SDL_FreeSurface( surfaces[ i ] );
+    }
+  }
+
+  if( !success )
+  {
+    free();
+  }
+
+  return success;
+}
+
+void LTextureAtlas::free()
+{
+  //Deallocate texture and regions
+  mTexture.free();
+  mClips.clear();
+}
+
+SDL_Rect* LTextureAtlas::getClip( std::string path )
+{
+  //Find packed region
+  std::map<std::string, SDL_Rect>::iterator it = mClips.find( path );
+  if( it == mClips.end() )
+  {
+    return NULL;
+  }
+
+  return &it->second;
+}
+
+LTexture* LTextureAtlas::getTexture()
+{
+  return &mTexture;
+}
+
 // Starts up SDL and creates window
 bool init();
 
@@ -276,51 +492,34 @@ bool loadMedia() {
   // Loading success flag
   bool success = true;
 
-  //Load press texture
-	if( !gPressTexture.loadFromFile( "Lesson_18/press.png" ) )
-	{
-		printf( "Failed to load press texture!\n" );
-		success = false;
-	}
-	
-	//Load up texture
-	if( !gUpTexture.loadFromFile( "Lesson_18/up.png" ) )
-	{
-		printf( "Failed to load up texture!\n" );
-		success = false;
-	}
-
-	//Load down texture
-	if( !gDownTexture.loadFromFile( "Lesson_18/down.png" ) )
-	{
-		printf( "Failed to load down texture!\n" );
-		success = false;
-	}
-
-	//Load left texture
-	if( !gLeftTexture.loadFromFile( "Lesson_18/left.png" ) )
-	{
-		printf( "Failed to load left texture!\n" );
-		success = false;
-	}
-
-	//Load right texture
-	if( !gRightTexture.loadFromFile( "Lesson_18/right.png" ) )
-	{
-		printf( "Failed to load right texture!\n" );
-		success = false;
-	}
-  
+  //Pack key press textures into one atlas
+  std::vector<std::string> keyPaths;
+  keyPaths.push_back( "Lesson_18/press.png" );
+  keyPaths.push_back( "Lesson_18/up.png" );
+  keyPaths.push_back( "Lesson_18/down.png" );
+  keyPaths.push_back( "Lesson_18/left.png" );
+  keyPaths.push_back( "Lesson_18/right.png" );
+  if( !gKeyAtlas.loadFromFiles( keyPaths, 2048 ) )
+  {
+    printf( "Failed to load key press atlas!\n" );
+    success = false;
+  }
+  else
+  {
+    //Get key press regions
+    gPressClip = gKeyAtlas.getClip( "Lesson_18/press.png" );
+    gUpClip = gKeyAtlas.getClip( "Lesson_18/up.png" );
+    gDownClip = gKeyAtlas.getClip( "Lesson_18/down.png" );
+    gLeftClip = gKeyAtlas.getClip( "Lesson_18/left.png" );
+    gRightClip = gKeyAtlas.getClip( "Lesson_18/right.png" );
+  }
+
   return success;
 }
 
 void close() {
 	//Free loaded images
-	gPressTexture.free();
-	gUpTexture.free();
-	gDownTexture.free();
-	gLeftTexture.free();
-	gRightTexture.free();
+	gKeyAtlas.free();
 
   // Destroy window
   SDL_DestroyRenderer( gRenderer );
@@ -348,8 +547,8 @@ int main(int argc, char *args[]) {
       // Event handler
       SDL_Event e;
 
-      //Current rendererd texture
-      LTexture* currentTexture = NULL;
+      //Current rendererd region of the atlas
+      SDL_Rect* currentClip = NULL;
 
       // While application is running
       while (!quit) {
@@ -365,23 +564,23 @@ int main(int argc, char *args[]) {
         const Uint8* currentKeyStates = SDL_GetKeyboardState(NULL);
         if( currentKeyStates[ SDL_SCANCODE_UP ] )
         {
-          currentTexture = &gUpTexture;
+          currentClip = gUpClip;
         }
         else if( currentKeyStates[ SDL_SCANCODE_DOWN ] )
         {
-          currentTexture = &gDownTexture;
+          currentClip = gDownClip;
         }
         else if( currentKeyStates[ SDL_SCANCODE_LEFT ] )
         {
-          currentTexture = &gLeftTexture;
+          currentClip = gLeftClip;
         }
         else if( currentKeyStates[ SDL_SCANCODE_RIGHT ] )
         {
-          currentTexture = &gRightTexture;
+          currentClip = gRightClip;
         }
         else
         {
-          currentTexture = &gPressTexture; 
+          currentClip = gPressClip; 
         }
 
         //Clear screen
@@ -389,7 +588,7 @@ int main(int argc, char *args[]) {
         SDL_RenderClear( gRenderer );
 
         //Render current texture
-        currentTexture->render(0,0);
+        gKeyAtlas.getTexture()->render( 0, 0, currentClip );
 
         // Update screen
         SDL_RenderPresent( gRenderer );
@@ -6,11 +6,17 @@
 #include <stdio.h>
 #include <string>
 #include <sstream>
+#include <vector>
+#include <map>
 
 // Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+//Glyph atlas texture size and the gap left around each glyph
+const int GLYPH_ATLAS_SIZE = 512;
+const int GLYPH_PADDING = 1;
+
 // Starts up SDL and creates window
 bool init();
 
@@ -20,6 +26,9 @@ bool loadMedia();
 // Frees media and shuts down SDL
 void close();
 
+//Reads the UTF-8 character at index as UCS-2 and moves index past it
+Uint16 decodeUTF8( std::string& text, size_t& index );
+
 //Texture wrapper class
 class LTexture
 {
@@ -77,25 +86,102 @@ class LTimer
     void pause();
     void unpause();
 
-    //Gets the timer's time
+    //Gets the timer's time in milliseconds
     Uint32 getTicks();
 
+    //Gets the timer's time in finer units
+    Uint64 getMicroseconds();
+    Uint64 getNanoseconds();
+
     //Checks the status of the timer
     bool isStarted();
     bool isPaused();
 
   private:
-    //The clock time when the timer started
-    Uint32 mStartTicks;
+    //Gets the timer's time in performance counter units
+    Uint64 getCounts();
 
-    //The ticks stored when the timer was paused
-    Uint32 mPausedTicks;
+    //Converts the timer's time to units per second
+    Uint64 getTime( Uint64 unitsPerSecond );
+
+    //The performance counter when the timer started
+    Uint64 mStartCounts;
+
+    //The counts stored when the timer was paused
+    Uint64 mPausedCounts;
 
     //The timer status
     bool mPaused;
     bool mStarted;
 };
 
+//A glyph in the atlas
+struct LGlyph
+{
+  //Glyph image in the atlas, empty for glyphs that can't be drawn
+  SDL_Rect clip;
+
+  //How far the pen moves after the glyph
+  int advance;
+};
+
+//Font glyphs rasterized once into a shared texture and drawn as batched quads
+class LGlyphAtlas
+{
+  public:
+    //Initializes variables
+    LGlyphAtlas();
+
+    //Deallocates memory
+    ~LGlyphAtlas();
+
+    //Rasterizes the printable ASCII glyphs of a font
+    bool create( TTF_Font* font );
+
+    //Deallocates texture and glyphs
+    void free();
+
+    //Gets a glyph, rasterizing it on first use
+    LGlyph& getGlyph( Uint16 ch );
+
+    //Gets the kerning between two glyphs
+    int getKerning( Uint16 previous, Uint16 ch );
+
+    //Gets the distance between lines
+    int getLineHeight();
+
+    //Gets the width of the widest line of text
+    int measureText( std::string text );
+
+    //Draws text with its top left at given point in one call
+    void renderText( int x, int y, std::string text, SDL_Color color );
+
+  private:
+    //Rasterizes a glyph into free atlas space
+    void addGlyph( Uint16 ch );
+
+    //Adds a glyph quad with its top left at given point to the batch
+    void queueGlyph( LGlyph& glyph, int x, int y, SDL_Color color );
+
+    //Font the glyphs come from
+    TTF_Font* mFont;
+
+    //The glyph images
+    SDL_Texture* mTexture;
+
+    //Shelf being filled with glyphs
+    int mShelfX;
+    int mShelfY;
+    int mShelfHeight;
+
+    //Glyphs rasterized so far
+    std::map<Uint16, LGlyph> mGlyphs;
+
+    //Quads of the text being drawn
+    std::vector<SDL_Vertex> mVertices;
+    std::vector<int> mIndices;
+};
+
 // The window we'll be rendering to
 SDL_Window *gWindow = NULL;
 
@@ -105,10 +191,12 @@ SDL_Renderer *gRenderer = NULL;
 //Globally used font
 TTF_Font* gFont = NULL;
 
+//Glyphs for text that changes every frame
+LGlyphAtlas gTextAtlas;
+
 //Rendered texture
 LTexture gStartPromptTextTexture;
 LTexture gPausePromptTextTexture;
-LTexture gTimeTextTexture;
 
 LTexture::LTexture()
 {
@@ -256,8 +344,8 @@ int LTexture::getHeight()
 LTimer::LTimer()
 {
   //Initialize the variables
-  mStartTicks = 0;
-  mPausedTicks = 0;
+  mStartCounts = 0;
+  mPausedCounts = 0;
 
   mPaused = false;
   mStarted = false;
@@ -272,8 +360,8 @@ void LTimer::start()
   mPaused = false;
 
   //Get the current clock time
-  mStartTicks = SDL_GetTicks();
-  mPausedTicks = 0;
+  mStartCounts = SDL_GetPerformanceCounter();
+  mPausedCounts = 0;
 }
 
 void LTimer::stop()
@@ -285,8 +373,8 @@ void LTimer::stop()
   mPaused = false;
 
   //Clear tick variables
-  mStartTicks = 0;
-  mPausedTicks = 0;
+  mStartCounts = 0;
+  mPausedCounts = 0;
 }
 
 void LTimer::pause()
@@ -298,8 +386,8 @@ void LTimer::pause()
     mPaused = true;
 
     //Reset the starting ticks
-    mPausedTicks = SDL_GetTicks() - mStartTicks;
-    mStartTicks = 0;
+    mPausedCounts = SDL_GetPerformanceCounter() - mStartCounts;
+    mStartCounts = 0;
   }
 }
 
@@ -312,17 +400,17 @@ void LTimer::unpause()
     mPaused = false;
 
     //Reset the starting ticks
-    mStartTicks = SDL_GetTicks() - mPausedTicks;
+    mStartCounts = SDL_GetPerformanceCounter() - mPausedCounts;
 
     //Reset the paused ticks
-    mPausedTicks = 0;
+    mPausedCounts = 0;
   }
 }
 
-Uint32 LTimer::getTicks()
+Uint64 LTimer::getCounts()
 {
   //The actual timer time
-  Uint32 time = 0;
+  Uint64 time = 0;
 
   //If the timer is running
   if( mStarted )
@@ -330,19 +418,42 @@ Uint32 LTimer::getTicks()
     //If the timer is paused
     if( mPaused )
     {
-      //Return the number of ticks when the timer was paused
-      time = mPausedTicks;
+      //Return the number of counts when the timer was paused
+      time = mPausedCounts;
     }
     else
     {
       //Return the current time minus the start time
-      time = SDL_GetTicks() - mStartTicks;
+      time = SDL_GetPerformanceCounter() - mStartCounts;
     }
   }
 
   return time;
 }
 
+Uint64 LTimer::getTime( Uint64 unitsPerSecond )
+{
+  //Convert whole seconds apart from the remainder so the multiply can't overflow
+  Uint64 counts = getCounts();
+  Uint64 frequency = SDL_GetPerformanceFrequency();
+  return counts / frequency * unitsPerSecond + counts % frequency * unitsPerSecond / frequency;
+}
+
+Uint32 LTimer::getTicks()
+{
+  return (Uint32)getTime( 1000 );
+}
+
+Uint64 LTimer::getMicroseconds()
+{
+  return getTime( 1000000 );
+}
+
+Uint64 LTimer::getNanoseconds()
+{
+  return getTime( 1000000000 );
+}
+
 bool LTimer::isStarted()
 {
   //Timer is running and paused or unpaused
@@ -355,6 +466,296 @@ bool LTimer::isPaused()
   return mPaused && mStarted;
 }
 
+LGlyphAtlas::LGlyphAtlas()
+{
+  //Initialize
+  mFont = NULL;
+  mTexture = NULL;
+  mShelfX = 0;
+  mShelfY = 0;
+  mShelfHeight = 0;
+}
+
+LGlyphAtlas::~LGlyphAtlas()
+{
+  //Deallocate
+  free();
+}
+
+bool LGlyphAtlas::create( TTF_Font* font )
+{
+  //Get rid of preexisting atlas
+  free();
+
+  //Create the atlas texture
+  mTexture = SDL_CreateTexture( gRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC, GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE );
+  if( mTexture == NULL )
+  {
+    printf( "Unable to create glyph atlas! SDL Error: %s\n", SDL_GetError() );
+    return false;
+  }
+  SDL_SetTextureBlendMode( mTexture, SDL_BLENDMODE_BLEND );
+
+  //Clear it so filtering at glyph edges only picks up transparent pixels
+  std::vector<Uint32> blank( GLYPH_ATLAS_SIZE * GLYPH_ATLAS_SIZE, 0 );
+  SDL_UpdateTexture( mTexture, NULL, &blank[ 0 ], GLYPH_ATLAS_SIZE * 4 );
+
+  //Rasterize the common glyphs up front
+  mFont = font;
+  for( Uint16 ch = ' '; ch <= '~'; ++ch )
+  {
+    addGlyph( ch );
+  }
+
+  return true;
+}
+
+void LGlyphAtlas::free()
+{
+  //Free texture if it exists
+  if( mTexture != NULL )
+  {
+    SDL_DestroyTexture( mTexture );
+    mTexture = NULL;
+  }
+  mFont = NULL;
+  mShelfX = 0;
+  mShelfY = 0;
+  mShelfHeight = 0;
+  mGlyphs.clear();
+}
+
+void LGlyphAtlas::addGlyph( Uint16 ch )
+{
+  //Glyphs that can't be drawn still advance the pen
+  LGlyph& glyph = mGlyphs[ ch ];
+  glyph.clip.x = 0;
+  glyph.clip.y = 0;
+  glyph.clip.w = 0;
+  glyph.clip.h = 0;
+  glyph.advance = 0;
+
+  int minX, maxX, minY, maxY;
+  if( TTF_GlyphMetrics( mFont, ch, &minX, &maxX, &minY, &maxY, &glyph.advance ) != 0 )
+  {
+    return;
+  }
+
+  //Rasterize the glyph in white so vertex colors can tint it
+  SDL_Color white = { 0xFF, 0xFF, 0xFF, 0xFF };
+  SDL_Surface* glyphSurface = TTF_RenderGlyph_Blended( mFont, ch, white );
+  if( glyphSurface == NULL )
+  {
+    return;
+  }
+  SDL_Surface* formattedSurface = SDL_ConvertSurfaceFormat( glyphSurface, SDL_PIXELFORMAT_RGBA8888, 0 );
+  SDL_FreeSurface( glyphSurface );
+  if( formattedSurface == NULL )
+  {
+    return;
+  }
+
+  //Start a new shelf if the glyph doesn't fit on this one
+  if( mShelfX + formattedSurface->w > GLYPH_ATLAS_SIZE )
+  {
+    mShelfX = 0;
+    mShelfY += mShelfHeight + GLYPH_PADDING;
+    mShelfHeight = 0;
+  }
+
+  //Copy the glyph into the atlas if there's room
+  if( mShelfY + formattedSurface->h <= GLYPH_ATLAS_SIZE && formattedSurface->w <= GLYPH_ATLAS_SIZE )
+  {
+    SDL_Rect clip = { mShelfX, mShelfY, formattedSurface->w, formattedSurface->h };
+    SDL_UpdateTexture( mTexture, &clip, formattedSurface->pixels, formattedSurface->pitch );
+    glyph.clip = clip;
+
+    mShelfX += clip.w + GLYPH_PADDING;
+    if( clip.h > mShelfHeight )
+    {
+      mShelfHeight = clip.h;
+    }
+  }
+  else
+  {
+    printf( "Glyph atlas is full!\n" );
+  }
+
+  SDL_FreeSurface( formattedSurface );
+}
+
+LGlyph& LGlyphAtlas::getGlyph( Uint16 ch )
+{
+  //Rasterize glyphs on first use
+  std::map<Uint16, LGlyph>::iterator glyph = mGlyphs.find( ch );
+  if( glyph == mGlyphs.end() )
+  {
+    addGlyph( ch );
+    glyph = mGlyphs.find( ch );
+  }
+
+  return glyph->second;
+}
+
+int LGlyphAtlas::getKerning( Uint16 previous, Uint16 ch )
+{
+  //Nothing to kern against at the start of a line
+  if( previous == 0 )
+  {
+    return 0;
+  }
+
+  return TTF_GetFontKerningSizeGlyphs( mFont, previous, ch );
+}
+
+int LGlyphAtlas::getLineHeight()
+{
+  return TTF_FontLineSkip( mFont );
+}
+
+int LGlyphAtlas::measureText( std::string text )
+{
+  int width = 0;
+  int penX = 0;
+  Uint16 previous = 0;
+
+  //Lay out text without drawing it
+  size_t index = 0;
+  while( index < text.length() )
+  {
+    Uint16 ch = decodeUTF8( text, index );
+    if( ch == '\n' )
+    {
+      penX = 0;
+      previous = 0;
+      continue;
+    }
+
+    penX += getKerning( previous, ch ) + getGlyph( ch ).advance;
+    previous = ch;
+    if( penX > width )
+    {
+      width = penX;
+    }
+  }
+
+  return width;
+}
+
+void LGlyphAtlas::queueGlyph( LGlyph& glyph, int x, int y, SDL_Color color )
+{
+  //Texture coordinates of the glyph
+  float left = (float)glyph.clip.x / GLYPH_ATLAS_SIZE;
+  float top = (float)glyph.clip.y / GLYPH_ATLAS_SIZE;
+  float right = (float)( glyph.clip.x + glyph.clip.w ) / GLYPH_ATLAS_SIZE;
+  float bottom = (float)( glyph.clip.y + glyph.clip.h ) / GLYPH_ATLAS_SIZE;
+
+  //Two triangles per glyph
+  int first = mVertices.size();
+  SDL_Vertex vertex;
+  vertex.color = color;
+  vertex.position.x = (float)x;
+  vertex.position.y = (float)y;
+  vertex.tex_coord.x = left;
+  vertex.tex_coord.y = top;
+  mVertices.push_back( vertex );
+  vertex.position.x = (float)( x + glyph.clip.w );
+  vertex.tex_coord.x = right;
+  mVertices.push_back( vertex );
+  vertex.position.y = (float)( y + glyph.clip.h );
+  vertex.tex_coord.y = bottom;
+  mVertices.push_back( vertex );
+  vertex.position.x = (float)x;
+  vertex.tex_coord.x = left;
+  mVertices.push_back( vertex );
+
+  mIndices.push_back( first );
+  mIndices.push_back( first + 1 );
+  mIndices.push_back( first + 2 );
+  mIndices.push_back( first );
+  mIndices.push_back( first + 2 );
+  mIndices.push_back( first + 3 );
+}
+
+void LGlyphAtlas::renderText( int x, int y, std::string text, SDL_Color color )
+{
+  mVertices.clear();
+  mIndices.clear();
+
+  //Lay out glyphs along the pen
+  int penX = x;
+  int penY = y;
+  Uint16 previous = 0;
+  size_t index = 0;
+  while( index < text.length() )
+  {
+    Uint16 ch = decodeUTF8( text, index );
+    if( ch == '\n' )
+    {
+      penX = x;
+      penY += getLineHeight();
+      previous = 0;
+      continue;
+    }
+
+    LGlyph& glyph = getGlyph( ch );
+    penX += getKerning( previous, ch );
+    if( glyph.clip.w > 0 )
+    {
+      queueGlyph( glyph, penX, penY, color );
+    }
+    penX += glyph.advance;
+    previous = ch;
+  }
+
+  //Draw all glyphs at once
+  if( !mIndices.empty() )
+  {
+    SDL_RenderGeometry( gRenderer, mTexture, &mVertices[ 0 ], mVertices.size(), &mIndices[ 0 ], mIndices.size() );
+  }
+}
+
+Uint16 decodeUTF8( std::string& text, size_t& index )
+{
+  //Number of continuation bytes and the bits the lead byte holds
+  Uint8 lead = text[ index++ ];
+  int continuation = 0;
+  Uint32 ch = lead;
+  if( lead >= 0xF0 )
+  {
+    continuation = 3;
+    ch = lead & 0x07;
+  }
+  else if( lead >= 0xE0 )
+  {
+    continuation = 2;
+    ch = lead & 0x0F;
+  }
+  else if( lead >= 0xC0 )
+  {
+    continuation = 1;
+    ch = lead & 0x1F;
+  }
+  else if( lead >= 0x80 )
+  {
+    //Stray continuation byte
+    return '?';
+  }
+
+  //Add the continuation bits
+  for( int i = 0; i < continuation; ++i )
+  {
+    if( index >= text.length() || ( text[ index ] & 0xC0 ) != 0x80 )
+    {
+      return '?';
+    }
+    ch = ( ch << 6 ) | ( text[ index++ ] & 0x3F );
+  }
+
+  //Fonts are looked up by UCS-2
+  return ch > 0xFFFF ? '?' : (Uint16)ch;
+}
+
 bool init() {
   // Initialization flag
   bool success = true;
@@ -435,6 +836,13 @@ bool loadMedia() {
       printf( "Unable to render prompt texture!\n" );
       success = false;
     }
+
+    //Rasterize glyphs for the time
+    if( !gTextAtlas.create( gFont ) )
+    {
+      printf( "Unable to create glyph atlas!\n" );
+      success = false;
+    }
   }
 
   return success;
@@ -444,7 +852,7 @@ void close() {
   // Free loaded image
   gStartPromptTextTexture.free();
   gPausePromptTextTexture.free();
-  gTimeTextTexture.free();
+  gTextAtlas.free();
 
   //Free global font
   TTF_CloseFont( gFont );
@@ -477,8 +885,8 @@ int main(int argc, char *args[]) {
       // Event handler
       SDL_Event e;
 
-      //Set text color as black
-      SDL_Color textColor = { 0, 0, 255 };
+      //Set text color as black, opaque since glyph vertices carry alpha
+      SDL_Color textColor = { 0, 0, 255, 0xFF };
 
       //The application timer
       LTimer timer;
@@ -528,12 +936,6 @@ int main(int argc, char *args[]) {
         timeText.str( "" );
         timeText << "Seconds since start time " << ( timer.getTicks() / 1000.f );
 
-        //Render text
-        if( !gTimeTextTexture.loadFromRenderedText( timeText.str().c_str(), textColor ) )
-        {
-          printf( "Unable to render time texture!\n" );
-        }
-
         //Clear screen
         SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
         SDL_RenderClear( gRenderer );
@@ -541,7 +943,10 @@ int main(int argc, char *args[]) {
         //Render current frame
         gStartPromptTextTexture.render( ( SCREEN_WIDTH - gStartPromptTextTexture.getWidth() ) / 2, 0 );
         gPausePromptTextTexture.render( ( SCREEN_WIDTH - gPausePromptTextTexture.getWidth() ) / 2, gStartPromptTextTexture.getHeight() );
-        gTimeTextTexture.render( ( SCREEN_WIDTH - gTimeTextTexture.getWidth() ) / 2, ( SCREEN_HEIGHT - gTimeTextTexture.getHeight() ) / 2 );
+
+        //Lay the time out from the glyph atlas, new text uploads nothing
+        std::string time = timeText.str();
+        gTextAtlas.renderText( ( SCREEN_WIDTH - gTextAtlas.measureText( time ) ) / 2, ( SCREEN_HEIGHT - gTextAtlas.getLineHeight() ) / 2, time, textColor );
         // Update screen
         SDL_RenderPresent( gRenderer );
 
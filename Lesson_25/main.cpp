@@ -5,12 +5,42 @@
 #include <stdio.h>
 #include <string>
 #include <sstream>
+#include <vector>
+#include <list>
+#include <map>
+#include <algorithm>
 
 // Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
+
+//Glyph atlas texture size and the gap left around each glyph
+const int GLYPH_ATLAS_SIZE = 512;
+const int GLYPH_PADDING = 1;
+
+//Point size the font is opened at
+const int FONT_SIZE = 28;
+
+//Most rendered text textures kept around
+const int TEXT_CACHE_CAPACITY = 64;
+
+//Frame times kept for statistics, and how many recent ones the on screen summary covers
+const int FRAME_STATS_CAPACITY = 3600;
+const int FRAME_STATS_WINDOW = 120;
+
+//How often the on screen summary changes, slow enough to read
+const Uint32 HUD_REFRESH_MILLISECONDS = 250;
+
+//Space between the on screen summary labels and their values
+const int HUD_COLUMN_GAP = 8;
+
+//On screen summary rows
+const int HUD_ROWS = 3;
 const int SCREEN_FPS = 30;
-const int SCREEN_TICKS_PER_FRAME = 1000 / SCREEN_FPS;
+const Uint64 SCREEN_MICROSECONDS_PER_FRAME = 1000000 / SCREEN_FPS;
+
+//How long before a frame deadline to stop sleeping and spin, more is more precise and costs more CPU
+const Uint64 FRAME_SPIN_MICROSECONDS = 2000;
 
 // Starts up SDL and creates window
 bool init();
@@ -21,6 +51,9 @@ bool loadMedia();
 // Frees media and shuts down SDL
 void close();
 
+//Reads the UTF-8 character at index as UCS-2 and moves index past it
+Uint16 decodeUTF8( std::string& text, size_t& index );
+
 //Texture wrapper class
 class LTexture
 {
@@ -37,6 +70,9 @@ class LTexture
     //Creates image from font string
     bool loadFromRenderedText( std::string textureText, SDL_Color textColor );
 
+    //Creates image from string in given font
+    bool loadFromRenderedText( TTF_Font* font, std::string textureText, SDL_Color textColor );
+
     //Deallocate texture
     void free();
 
@@ -78,25 +114,230 @@ class LTimer
     void pause();
     void unpause();
 
-    //Gets the timer's time
+    //Gets the timer's time in milliseconds
     Uint32 getTicks();
 
+    //Gets the timer's time in finer units
+    Uint64 getMicroseconds();
+    Uint64 getNanoseconds();
+
     //Checks the status of the timer
     bool isStarted();
     bool isPaused();
 
   private:
-    //The clock time when the timer started
-    Uint32 mStartTicks;
+    //Gets the timer's time in performance counter units
+    Uint64 getCounts();
+
+    //Converts the timer's time to units per second
+    Uint64 getTime( Uint64 unitsPerSecond );
 
-    //The ticks stored when the timer was paused
-    Uint32 mPausedTicks;
+    //The performance counter when the timer started
+    Uint64 mStartCounts;
+
+    //The counts stored when the timer was paused
+    Uint64 mPausedCounts;
 
     //The timer status
     bool mPaused;
     bool mStarted;
 };
 
+//Waits out the rest of each frame, sleeping while it's safe and spinning for the last stretch
+class LFramePacer
+{
+  public:
+    //Initializes variables
+    LFramePacer( Uint64 frameMicroseconds, Uint64 spinMicroseconds );
+
+    //Starts the first frame
+    void start();
+
+    //Waits until the current frame's deadline and starts the next frame
+    void waitForNextFrame();
+
+    //Sets how long before the deadline to stop sleeping, less saves power and more is on time more often
+    void setSpinTime( Uint64 spinMicroseconds );
+
+    //Gets how many frames ended after their deadline
+    int getMissedFrames();
+
+  private:
+    //Time since start
+    LTimer mTimer;
+
+    //Frame length and spin length
+    Uint64 mFrameTime;
+    Uint64 mSpinTime;
+
+    //When the current frame should end
+    Uint64 mDeadline;
+
+    //Late frames
+    int mMissedFrames;
+};
+
+//A glyph in the atlas
+struct LGlyph
+{
+  //Glyph image in the atlas, empty for glyphs that can't be drawn
+  SDL_Rect clip;
+
+  //How far the pen moves after the glyph
+  int advance;
+};
+
+//Font glyphs rasterized once into a shared texture and drawn as batched quads
+class LGlyphAtlas
+{
+  public:
+    //Initializes variables
+    LGlyphAtlas();
+
+    //Deallocates memory
+    ~LGlyphAtlas();
+
+    //Rasterizes the printable ASCII glyphs of a font
+    bool create( TTF_Font* font );
+
+    //Deallocates texture and glyphs
+    void free();
+
+    //Gets a glyph, rasterizing it on first use
+    LGlyph& getGlyph( Uint16 ch );
+
+    //Gets the kerning between two glyphs
+    int getKerning( Uint16 previous, Uint16 ch );
+
+    //Gets the distance between lines
+    int getLineHeight();
+
+    //Gets the width of the widest line of text
+    int measureText( std::string text );
+
+    //Draws text with its top left at given point in one call
+    void renderText( int x, int y, std::string text, SDL_Color color );
+
+  private:
+    //Rasterizes a glyph into free atlas space
+    void addGlyph( Uint16 ch );
+
+    //Adds a glyph quad with its top left at given point to the batch
+    void queueGlyph( LGlyph& glyph, int x, int y, SDL_Color color );
+
+    //Font the glyphs come from
+    TTF_Font* mFont;
+
+    //The glyph images
+    SDL_Texture* mTexture;
+
+    //Shelf being filled with glyphs
+    int mShelfX;
+    int mShelfY;
+    int mShelfHeight;
+
+    //Glyphs rasterized so far
+    std::map<Uint16, LGlyph> mGlyphs;
+
+    //Quads of the text being drawn
+    std::vector<SDL_Vertex> mVertices;
+    std::vector<int> mIndices;
+};
+
+//What a rendered text texture was made from
+struct LTextKey
+{
+  TTF_Font* font;
+  int size;
+  Uint32 color;
+  std::string text;
+
+  //Orders keys for the map
+  bool operator<( const LTextKey& other ) const;
+};
+
+//A cached text texture
+struct LCachedText
+{
+  LTextKey key;
+  LTexture* texture;
+};
+
+//Rendered text textures reused while their text stays the same, least recently used dropped first
+class LTextCache
+{
+  public:
+    //Initializes variables
+    LTextCache( int capacity );
+
+    //Deallocates textures
+    ~LTextCache();
+
+    //Gets texture of text, rendering it only if it isn't cached
+    LTexture* get( TTF_Font* font, int size, std::string text, SDL_Color color );
+
+    //Deallocates all textures
+    void clear();
+
+    //Gets the number of cached textures
+    int getSize();
+
+  private:
+    //Most textures kept
+    int mCapacity;
+
+    //Textures from most to least recently used
+    std::list<LCachedText> mEntries;
+
+    //Where each key is in the list
+    std::map<LTextKey, std::list<LCachedText>::iterator> mLookup;
+};
+
+//Frame time summary over recent frames, times in milliseconds
+struct FrameSummary
+{
+  int frames;
+  float min, max, mean;
+  float p50, p95, p99;
+  float onePercentLowFPS;
+};
+
+//Records recent frame times in a ring buffer and summarizes them
+class LFrameStats
+{
+  public:
+    //Allocates room for capacity frames
+    LFrameStats( int capacity );
+
+    //Records a frame's duration
+    void addFrame( Uint64 microseconds );
+
+    //Summarizes the most recent window frames, all recorded ones if window is 0
+    FrameSummary summarize( int window );
+
+    //Gets the number of frames recorded, up to capacity
+    int getCount();
+
+    //Writes recorded frame times oldest first, one per line
+    bool saveCSV( std::string path );
+
+    //Writes a summary of each window
+    bool saveJSON( std::string path, std::vector<int>& windows );
+
+  private:
+    //Frame times in microseconds, oldest overwritten first
+    std::vector<Uint32> mFrames;
+
+    //Next slot to write
+    int mNext;
+
+    //Frames recorded
+    int mCount;
+
+    //Sorted copy of a window for percentiles
+    std::vector<Uint32> mSorted;
+};
+
 // The window we'll be rendering to
 SDL_Window *gWindow = NULL;
 
@@ -106,8 +347,11 @@ SDL_Renderer *gRenderer = NULL;
 //Globally used font
 TTF_Font* gFont = NULL;
 
-//Rendered texture
-LTexture gTimeTextTexture;
+//Glyphs for text that changes every frame
+LGlyphAtlas gTextAtlas;
+
+//Rendered text
+LTextCache gTextCache( TEXT_CACHE_CAPACITY );
 
 LTexture::LTexture()
 {
@@ -165,12 +409,18 @@ bool LTexture::loadFromFile( std::string path )
 }
 
 bool LTexture::loadFromRenderedText( std::string textureText, SDL_Color textColor )
+{
+  //Render with the global font
+  return loadFromRenderedText( gFont, textureText, textColor );
+}
+
+bool LTexture::loadFromRenderedText( TTF_Font* font, std::string textureText, SDL_Color textColor )
 {
   //Get rid of preexisting texture
   free();
 
   //Render text surface
-  SDL_Surface* textSurface = TTF_RenderText_Solid( gFont, textureText.c_str(), textColor );
+  SDL_Surface* textSurface = TTF_RenderText_Solid( font, textureText.c_str(), textColor );
   if( textSurface == NULL )
   {
     printf( "Unable to render text surface! SDL_ttf Error: %s\n", TTF_GetError() );
@@ -255,8 +505,8 @@ int LTexture::getHeight()
 LTimer::LTimer()
 {
   //Initialize the variables
-  mStartTicks = 0;
-  mPausedTicks = 0;
+  mStartCounts = 0;
+  mPausedCounts = 0;
 
   mPaused = false;
   mStarted = false;
@@ -271,8 +521,8 @@ void LTimer::start()
   mPaused = false;
 
   //Get the current clock time
-  mStartTicks = SDL_GetTicks();
-  mPausedTicks = 0;
+  mStartCounts = SDL_GetPerformanceCounter();
+  mPausedCounts = 0;
 }
 
 void LTimer::stop()
@@ -284,8 +534,8 @@ void LTimer::stop()
   mPaused = false;
 
   //Clear tick variables
-  mStartTicks = 0;
-  mPausedTicks = 0;
+  mStartCounts = 0;
+  mPausedCounts = 0;
 }
 
 void LTimer::pause()
@@ -297,8 +547,8 @@ void LTimer::pause()
     mPaused = true;
 
     //Reset the starting ticks
-    mPausedTicks = SDL_GetTicks() - mStartTicks;
-    mStartTicks = 0;
+    mPausedCounts = SDL_GetPerformanceCounter() - mStartCounts;
+    mStartCounts = 0;
   }
 }
 
@@ -311,17 +561,17 @@ void LTimer::unpause()
     mPaused = false;
 
     //Reset the starting ticks
-    mStartTicks = SDL_GetTicks() - mPausedTicks;
+    mStartCounts = SDL_GetPerformanceCounter() - mPausedCounts;
 
     //Reset the paused ticks
-    mPausedTicks = 0;
+    mPausedCounts = 0;
   }
 }
 
-Uint32 LTimer::getTicks()
+Uint64 LTimer::getCounts()
 {
   //The actual timer time
-  Uint32 time = 0;
+  Uint64 time = 0;
 
   //If the timer is running
   if( mStarted )
@@ -329,19 +579,42 @@ Uint32 LTimer::getTicks()
     //If the timer is paused
     if( mPaused )
     {
-      //Return the number of ticks when the timer was paused
-      time = mPausedTicks;
+      //Return the number of counts when the timer was paused
+      time = mPausedCounts;
     }
     else
     {
       //Return the current time minus the start time
-      time = SDL_GetTicks() - mStartTicks;
+      time = SDL_GetPerformanceCounter() - mStartCounts;
     }
   }
 
   return time;
 }
 
+Uint64 LTimer::getTime( Uint64 unitsPerSecond )
+{
+  //Convert whole seconds apart from the remainder so the multiply can't overflow
+  Uint64 counts = getCounts();
+  Uint64 frequency = SDL_GetPerformanceFrequency();
+  return counts / frequency * unitsPerSecond + counts % frequency * unitsPerSecond / frequency;
+}
+
+Uint32 LTimer::getTicks()
+{
+  return (Uint32)getTime( 1000 );
+}
+
+Uint64 LTimer::getMicroseconds()
+{
+  return getTime( 1000000 );
+}
+
+Uint64 LTimer::getNanoseconds()
+{
+  return getTime( 1000000000 );
+}
+
 bool LTimer::isStarted()
 {
   //Timer is running and paused or unpaused
@@ -354,6 +627,544 @@ bool LTimer::isPaused()
   return mPaused && mStarted;
 }
 
+LFramePacer::LFramePacer( Uint64 frameMicroseconds, Uint64 spinMicroseconds )
+{
+  //Initialize the variables
+  mFrameTime = frameMicroseconds;
+  mSpinTime = spinMicroseconds;
+  mDeadline = 0;
+  mMissedFrames = 0;
+}
+
+void LFramePacer::start()
+{
+  //The first frame ends one frame from now
+  mTimer.start();
+  mDeadline = mFrameTime;
+}
+
+void LFramePacer::waitForNextFrame()
+{
+  Uint64 now = mTimer.getMicroseconds();
+
+  //Sleep while the scheduler waking late can't overshoot the deadline
+  if( now + mSpinTime < mDeadline )
+  {
+    SDL_Delay( (Uint32)( ( mDeadline - mSpinTime - now ) / 1000 ) );
+    now = mTimer.getMicroseconds();
+  }
+
+  //Spin the rest of the way
+  while( now < mDeadline )
+  {
+    now = mTimer.getMicroseconds();
+  }
+
+  //Deadlines follow each other so waiting errors don't add up
+  mDeadline += mFrameTime;
+
+  //If a whole frame was missed start over from now instead of rushing to catch up
+  if( now >= mDeadline )
+  {
+    mMissedFrames++;
+    mDeadline = now + mFrameTime;
+  }
+}
+
+void LFramePacer::setSpinTime( Uint64 spinMicroseconds )
+{
+  mSpinTime = spinMicroseconds;
+}
+
+int LFramePacer::getMissedFrames()
+{
+  return mMissedFrames;
+}
+
+bool LTextKey::operator<( const LTextKey& other ) const
+{
+  if( font != other.font )
+  {
+    return font < other.font;
+  }
+  if( size != other.size )
+  {
+    return size < other.size;
+  }
+  if( color != other.color )
+  {
+    return color < other.color;
+  }
+  return text < other.text;
+}
+
+LTextCache::LTextCache( int capacity )
+{
+  //Initialize
+  mCapacity = capacity;
+}
+
+LTextCache::~LTextCache()
+{
+  //Deallocate
+  clear();
+}
+
+LTexture* LTextCache::get( TTF_Font* font, int size, std::string text, SDL_Color color )
+{
+  LTextKey key = { font, size, (Uint32)( color.r << 24 | color.g << 16 | color.b << 8 | color.a ), text };
+
+  //Move a cached texture to the front
+  std::map<LTextKey, std::list<LCachedText>::iterator>::iterator found = mLookup.find( key );
+  if( found != mLookup.end() )
+  {
+    mEntries.splice( mEntries.begin(), mEntries, found->second );
+    return found->second->texture;
+  }
+
+  //Render it otherwise
+  LTexture* texture = new LTexture;
+  if( !texture->loadFromRenderedText( font, text, color ) )
+  {
+    delete texture;
+    return NULL;
+  }
+
+  //Drop the least recently used texture when full
+  if( (int)mEntries.size() >= mCapacity )
+  {
+    mLookup.erase( mEntries.back().key );
+    delete mEntries.back().texture;
+    mEntries.pop_back();
+  }
+
+  LCachedText entry = { key, texture };
+  mEntries.push_front( entry );
+  mLookup[ key ] = mEntries.begin();
+  return texture;
+}
+
+void LTextCache::clear()
+{
+  //Free all textures
+  for( std::list<LCachedText>::iterator entry = mEntries.begin(); entry != mEntries.end(); ++entry )
+  {
+    delete entry->texture;
+  }
+  mEntries.clear();
+  mLookup.clear();
+}
+
+int LTextCache::getSize()
+{
+  return mEntries.size();
+}
+
+LFrameStats::LFrameStats( int capacity )
+{
+  //Initialize the variables
+  mFrames.resize( capacity );
+  mNext = 0;
+  mCount = 0;
+}
+
+void LFrameStats::addFrame( Uint64 microseconds )
+{
+  //Overwrite the oldest frame once full
+  mFrames[ mNext ] = (Uint32)microseconds;
+  mNext = ( mNext + 1 ) % mFrames.size();
+  if( mCount < (int)mFrames.size() )
+  {
+    ++mCount;
+  }
+}
+
+FrameSummary LFrameStats::summarize( int window )
+{
+  FrameSummary summary = { 0, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+  if( window <= 0 || window > mCount )
+  {
+    window = mCount;
+  }
+  if( window == 0 )
+  {
+    return summary;
+  }
+
+  //Copy the newest frames, walking back from the write slot
+  mSorted.resize( window );
+  Uint64 total = 0;
+  for( int i = 0; i < window; ++i )
+  {
+    int slot = ( mNext - 1 - i + (int)mFrames.size() ) % mFrames.size();
+    mSorted[ i ] = mFrames[ slot ];
+    total += mFrames[ slot ];
+  }
+  std::sort( mSorted.begin(), mSorted.end() );
+
+  summary.frames = window;
+  summary.min = mSorted[ 0 ] / 1000.f;
+  summary.max = mSorted[ window - 1 ] / 1000.f;
+  summary.mean = total / 1000.f / window;
+
+  //Nearest rank percentiles
+  summary.p50 = mSorted[ ( 50 * window + 99 ) / 100 - 1 ] / 1000.f;
+  summary.p95 = mSorted[ ( 95 * window + 99 ) / 100 - 1 ] / 1000.f;
+  summary.p99 = mSorted[ ( 99 * window + 99 ) / 100 - 1 ] / 1000.f;
+
+  //Frame rate over the slowest 1% of frames
+  int slowest = ( window + 99 ) / 100;
+  Uint64 slowTotal = 0;
+  for( int i = window - slowest; i < window; ++i )
+  {
+    slowTotal += mSorted[ i ];
+  }
+  if( slowTotal > 0 )
+  {
+    summary.onePercentLowFPS = 1000000.f * slowest / slowTotal;
+  }
+
+  return summary;
+}
+
+int LFrameStats::getCount()
+{
+  return mCount;
+}
+
+bool LFrameStats::saveCSV( std::string path )
+{
+  FILE* file = fopen( path.c_str(), "w" );
+  if( file == NULL )
+  {
+    printf( "Unable to write %s!\n", path.c_str() );
+    return false;
+  }
+
+  //Oldest frame first
+  fprintf( file, "frame,milliseconds\n" );
+  for( int i = 0; i < mCount; ++i )
+  {
+    int slot = ( mNext - mCount + i + (int)mFrames.size() ) % mFrames.size();
+    fprintf( file, "%d,%.3f\n", i, mFrames[ slot ] / 1000.f );
+  }
+
+  fclose( file );
+  return true;
+}
+
+bool LFrameStats::saveJSON( std::string path, std::vector<int>& windows )
+{
+  FILE* file = fopen( path.c_str(), "w" );
+  if( file == NULL )
+  {
+    printf( "Unable to write %s!\n", path.c_str() );
+    return false;
+  }
+
+  fprintf( file, "{\n  \"frames\": %d,\n  \"windows\": [\n", mCount );
+  for( size_t i = 0; i < windows.size(); ++i )
+  {
+    FrameSummary summary = summarize( windows[ i ] );
+    fprintf( file, "    { \"frames\": %d, \"min\": %.3f, \"max\": %.3f, \"mean\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"onePercentLowFPS\": %.2f }%s\n",
+      summary.frames, summary.min, summary.max, summary.mean, summary.p50, summary.p95, summary.p99, summary.onePercentLowFPS, i + 1 < windows.size() ? "," : "" );
+  }
+  fprintf( file, "  ]\n}\n" );
+
+  fclose( file );
+  return true;
+}
+
+LGlyphAtlas::LGlyphAtlas()
+{
+  //Initialize
+  mFont = NULL;
+  mTexture = NULL;
+  mShelfX = 0;
+  mShelfY = 0;
+  mShelfHeight = 0;
+}
+
+LGlyphAtlas::~LGlyphAtlas()
+{
+  //Deallocate
+  free();
+}
+
+bool LGlyphAtlas::create( TTF_Font* font )
+{
+  //Get rid of preexisting atlas
+  free();
+
+  //Create the atlas texture
+  mTexture = SDL_CreateTexture( gRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC, GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE );
+  if( mTexture == NULL )
+  {
+    printf( "Unable to create glyph atlas! SDL Error: %s\n", SDL_GetError() );
+    return false;
+  }
+  SDL_SetTextureBlendMode( mTexture, SDL_BLENDMODE_BLEND );
+
+  //Clear it so filtering at glyph edges only picks up transparent pixels
+  std::vector<Uint32> blank( GLYPH_ATLAS_SIZE * GLYPH_ATLAS_SIZE, 0 );
+  SDL_UpdateTexture( mTexture, NULL, &blank[ 0 ], GLYPH_ATLAS_SIZE * 4 );
+
+  //Rasterize the common glyphs up front
+  mFont = font;
+  for( Uint16 ch = ' '; ch <= '~'; ++ch )
+  {
+    addGlyph( ch );
+  }
+
+  return true;
+}
+
+void LGlyphAtlas::free()
+{
+  //Free texture if it exists
+  if( mTexture != NULL )
+  {
+    SDL_DestroyTexture( mTexture );
+    mTexture = NULL;
+  }
+  mFont = NULL;
+  mShelfX = 0;
+  mShelfY = 0;
+  mShelfHeight = 0;
+  mGlyphs.clear();
+}
+
+void LGlyphAtlas::addGlyph( Uint16 ch )
+{
+  //Glyphs that can't be drawn still advance the pen
+  LGlyph& glyph = mGlyphs[ ch ];
+  glyph.clip.x = 0;
+  glyph.clip.y = 0;
+  glyph.clip.w = 0;
+  glyph.clip.h = 0;
+  glyph.advance = 0;
+
+  int minX, maxX, minY, maxY;
+  if( TTF_GlyphMetrics( mFont, ch, &minX, &maxX, &minY, &maxY, &glyph.advance ) != 0 )
+  {
+    return;
+  }
+
+  //Rasterize the glyph in white so vertex colors can tint it
+  SDL_Color white = { 0xFF, 0xFF, 0xFF, 0xFF };
+  SDL_Surface* glyphSurface = TTF_RenderGlyph_Blended( mFont, ch, white );
+  if( glyphSurface == NULL )
+  {
+    return;
+  }
+  SDL_Surface* formattedSurface = SDL_ConvertSurfaceFormat( glyphSurface, SDL_PIXELFORMAT_RGBA8888, 0 );
+  SDL_FreeSurface( glyphSurface );
+  if( formattedSurface == NULL )
+  {
+    return;
+  }
+
+  //Start a new shelf if the glyph doesn't fit on this one
+  if( mShelfX + formattedSurface->w > GLYPH_ATLAS_SIZE )
+  {
+    mShelfX = 0;
+    mShelfY += mShelfHeight + GLYPH_PADDING;
+    mShelfHeight = 0;
+  }
+
+  //Copy the glyph into the atlas if there's room
+  if( mShelfY + formattedSurface->h <= GLYPH_ATLAS_SIZE && formattedSurface->w <= GLYPH_ATLAS_SIZE )
+  {
+    SDL_Rect clip = { mShelfX, mShelfY, formattedSurface->w, formattedSurface->h };
+    SDL_UpdateTexture( mTexture, &clip, formattedSurface->pixels, formattedSurface->pitch );
+    glyph.clip = clip;
+
+    mShelfX += clip.w + GLYPH_PADDING;
+    if( clip.h > mShelfHeight )
+    {
+      mShelfHeight = clip.h;
+    }
+  }
+  else
+  {
+    printf( "Glyph atlas is full!\n" );
+  }
+
+  SDL_FreeSurface( formattedSurface );
+}
+
+LGlyph& LGlyphAtlas::getGlyph( Uint16 ch )
+{
+  //Rasterize glyphs on first use
+  std::map<Uint16, LGlyph>::iterator glyph = mGlyphs.find( ch );
+  if( glyph == mGlyphs.end() )
+  {
+    addGlyph( ch );
+    glyph = mGlyphs.find( ch );
+  }
+
+  return glyph->second;
+}
+
+int LGlyphAtlas::getKerning( Uint16 previous, Uint16 ch )
+{
+  //Nothing to kern against at the start of a line
+  if( previous == 0 )
+  {
+    return 0;
+  }
+
+  return TTF_GetFontKerningSizeGlyphs( mFont, previous, ch );
+}
+
+int LGlyphAtlas::getLineHeight()
+{
+  return TTF_FontLineSkip( mFont );
+}
+
+int LGlyphAtlas::measureText( std::string text )
+{
+  int width = 0;
+  int penX = 0;
+  Uint16 previous = 0;
+
+  //Lay out text without drawing it
+  size_t index = 0;
+  while( index < text.length() )
+  {
+    Uint16 ch = decodeUTF8( text, index );
+    if( ch == '\n' )
+    {
+      penX = 0;
+      previous = 0;
+      continue;
+    }
+
+    penX += getKerning( previous, ch ) + getGlyph( ch ).advance;
+    previous = ch;
+    if( penX > width )
+    {
+      width = penX;
+    }
+  }
+
+  return width;
+}
+
+void LGlyphAtlas::queueGlyph( LGlyph& glyph, int x, int y, SDL_Color color )
+{
+  //Texture coordinates of the glyph
+  float left = (float)glyph.clip.x / GLYPH_ATLAS_SIZE;
+  float top = (float)glyph.clip.y / GLYPH_ATLAS_SIZE;
+  float right = (float)( glyph.clip.x + glyph.clip.w ) / GLYPH_ATLAS_SIZE;
+  float bottom = (float)( glyph.clip.y + glyph.clip.h ) / GLYPH_ATLAS_SIZE;
+
+  //Two triangles per glyph
+  int first = mVertices.size();
+  SDL_Vertex vertex;
+  vertex.color = color;
+  vertex.position.x = (float)x;
+  vertex.position.y = (float)y;
+  vertex.tex_coord.x = left;
+  vertex.tex_coord.y = top;
+  mVertices.push_back( vertex );
+  vertex.position.x = (float)( x + glyph.clip.w );
+  vertex.tex_coord.x = right;
+  mVertices.push_back( vertex );
+  vertex.position.y = (float)( y + glyph.clip.h );
+  vertex.tex_coord.y = bottom;
+  mVertices.push_back( vertex );
+  vertex.position.x = (float)x;
+  vertex.tex_coord.x = left;
+  mVertices.push_back( vertex );
+
+  mIndices.push_back( first );
+  mIndices.push_back( first + 1 );
+  mIndices.push_back( first + 2 );
+  mIndices.push_back( first );
+  mIndices.push_back( first + 2 );
+  mIndices.push_back( first + 3 );
+}
+
+void LGlyphAtlas::renderText( int x, int y, std::string text, SDL_Color color )
+{
+  mVertices.clear();
+  mIndices.clear();
+
+  //Lay out glyphs along the pen
+  int penX = x;
+  int penY = y;
+  Uint16 previous = 0;
+  size_t index = 0;
+  while( index < text.length() )
+  {
+    Uint16 ch = decodeUTF8( text, index );
+    if( ch == '\n' )
+    {
+      penX = x;
+      penY += getLineHeight();
+      previous = 0;
+      continue;
+    }
+
+    LGlyph& glyph = getGlyph( ch );
+    penX += getKerning( previous, ch );
+    if( glyph.clip.w > 0 )
+    {
+      queueGlyph( glyph, penX, penY, color );
+    }
+    penX += glyph.advance;
+    previous = ch;
+  }
+
+  //Draw all glyphs at once
+  if( !mIndices.empty() )
+  {
+    SDL_RenderGeometry( gRenderer, mTexture, &mVertices[ 0 ], mVertices.size(), &mIndices[ 0 ], mIndices.size() );
+  }
+}
+
+Uint16 decodeUTF8( std::string& text, size_t& index )
+{
+  //Number of continuation bytes and the bits the lead byte holds
+  Uint8 lead = text[ index++ ];
+  int continuation = 0;
+  Uint32 ch = lead;
+  if( lead >= 0xF0 )
+  {
+    continuation = 3;
+    ch = lead & 0x07;
+  }
+  else if( lead >= 0xE0 )
+  {
+    continuation = 2;
+    ch = lead & 0x0F;
+  }
+  else if( lead >= 0xC0 )
+  {
+    continuation = 1;
+    ch = lead & 0x1F;
+  }
+  else if( lead >= 0x80 )
+  {
+    //Stray continuation byte
+    return '?';
+  }
+
+  //Add the continuation bits
+  for( int i = 0; i < continuation; ++i )
+  {
+    if( index >= text.length() || ( text[ index ] & 0xC0 ) != 0x80 )
+    {
+      return '?';
+    }
+    ch = ( ch << 6 ) | ( text[ index++ ] & 0x3F );
+  }
+
+  //Fonts are looked up by UCS-2
+  return ch > 0xFFFF ? '?' : (Uint16)ch;
+}
+
 bool init() {
   // Initialization flag
   bool success = true;
@@ -412,7 +1223,7 @@ bool loadMedia() {
   bool success = true;
 
   //Open the font
-  gFont = TTF_OpenFont( "Lesson_24/lazy.ttf", 28 );
+  gFont = TTF_OpenFont( "Lesson_24/lazy.ttf", FONT_SIZE );
   if( gFont == NULL )
   {
     printf( "Failed to load lazy font! SDL_ttf Error: %s\n", TTF_GetError() );
@@ -420,9 +1231,12 @@ bool loadMedia() {
   }
   else
   {
-    //Set text color as black
-    SDL_Color textColor = { 0, 0, 255 };
-
+    //Rasterize glyphs for the changing numbers
+    if( !gTextAtlas.create( gFont ) )
+    {
+      printf( "Unable to create glyph atlas!\n" );
+      success = false;
+    }
   }
 
   return success;
@@ -430,7 +1244,8 @@ bool loadMedia() {
 
 void close() {
   // Free loaded image
-  gTimeTextTexture.free();
+  gTextCache.clear();
+  gTextAtlas.free();
 
   //Free global font
   TTF_CloseFont( gFont );
@@ -463,27 +1278,34 @@ int main(int argc, char *args[]) {
       // Event handler
       SDL_Event e;
 
-      //Set text color as black
-      SDL_Color textColor = { 0, 0, 255 };
+      //Set text color as black, opaque since glyph vertices carry alpha
+      SDL_Color textColor = { 0, 0, 255, 0xFF };
+
+      //Times each frame
+      LTimer frameTimer;
 
-      //The application timer
-      LTimer fpsTimer;
+      //Recent frame times
+      LFrameStats frameStats( FRAME_STATS_CAPACITY );
 
-      //The frames per second cap timer
-      LTimer capTimer;
+      //Keeps frames evenly spaced
+      LFramePacer framePacer( SCREEN_MICROSECONDS_PER_FRAME, FRAME_SPIN_MICROSECONDS );
 
       //In memory text stream
       std::stringstream timeText;
 
-      //Start counting frames per second
-      int countedFrames = 0;
-      fpsTimer.start();
+      //Summary labels, which never change
+      std::string hudLabels[ HUD_ROWS ] = { "FPS", "1% low", "p99 ms" };
+
+      //Summary values shown on screen and when they were last refreshed
+      std::string hudValues[ HUD_ROWS ];
+      Uint32 hudTicks = 0;
+
+      //Start timing the first frame
+      frameTimer.start();
+      framePacer.start();
       
       // While application is running
       while (!quit) {
-        //Start cap timer
-        capTimer.start();
-
         // Handle events on queue
         while (SDL_PollEvent(&e) != 0) {
           // User requests quit
@@ -492,41 +1314,67 @@ int main(int argc, char *args[]) {
           }
         }
 
-        //Calculate and correct fps
-        float avgFPS = countedFrames / ( fpsTimer.getTicks() / 1000.f );
-        if( avgFPS > 2000000 )
+        //Summarize recent frames a few times a second, every frame the text would never repeat
+        if( hudValues[ 0 ].empty() || SDL_GetTicks() - hudTicks >= HUD_REFRESH_MILLISECONDS )
         {
-          avgFPS = 0;
-        }
+          FrameSummary summary = frameStats.summarize( FRAME_STATS_WINDOW );
 
-        //Set text to be rendered
-        timeText.str( "" );
-        timeText << "Average Frames Per Second " << avgFPS;
-
-        //Render text
-        if( !gTimeTextTexture.loadFromRenderedText( timeText.str().c_str(), textColor ) )
-        {
-          printf( "Unable to render time texture!\n" );
+          //Set text to be rendered
+          float values[ HUD_ROWS ] = { summary.mean > 0.f ? 1000.f / summary.mean : 0.f, summary.onePercentLowFPS, summary.p99 };
+          for( int i = 0; i < HUD_ROWS; ++i )
+          {
+            timeText.str( "" );
+            timeText.precision( 3 );
+            timeText << values[ i ];
+            hudValues[ i ] = timeText.str();
+          }
+          hudTicks = SDL_GetTicks();
         }
 
         //Clear screen
         SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
         SDL_RenderClear( gRenderer );
 
-        //Render current frame
-        gTimeTextTexture.render( ( SCREEN_WIDTH - gTimeTextTexture.getWidth() ) / 2, ( SCREEN_HEIGHT - gTimeTextTexture.getHeight() ) / 2 );
+        //Render the summary centered, labels right aligned against their values
+        int rowHeight = gTextAtlas.getLineHeight();
+        int rowY = ( SCREEN_HEIGHT - rowHeight * HUD_ROWS ) / 2;
+        for( int i = 0; i < HUD_ROWS; ++i )
+        {
+          //Labels are rendered once and reused from the cache
+          LTexture* labelTexture = gTextCache.get( gFont, FONT_SIZE, hudLabels[ i ], textColor );
+          if( labelTexture == NULL )
+          {
+            printf( "Unable to render label texture!\n" );
+          }
+          else
+          {
+            labelTexture->render( SCREEN_WIDTH / 2 - HUD_COLUMN_GAP / 2 - labelTexture->getWidth(), rowY );
+          }
+
+          //Values change every refresh, so they're laid out from the glyph atlas
+          gTextAtlas.renderText( SCREEN_WIDTH / 2 + HUD_COLUMN_GAP / 2, rowY, hudValues[ i ], textColor );
+          rowY += rowHeight;
+        }
         // Update screen
         SDL_RenderPresent( gRenderer );
-        ++countedFrames;
         
-        //if frame finished early
-        int frameTicks = capTimer.getTicks();
-        if( frameTicks < SCREEN_TICKS_PER_FRAME )
-        {
-          //Wait remaning time
-          SDL_Delay( SCREEN_TICKS_PER_FRAME - frameTicks );
-        }
+        //Wait remaining time
+        framePacer.waitForNextFrame();
+
+        //Record the whole frame, wait included
+        frameStats.addFrame( frameTimer.getMicroseconds() );
+        frameTimer.start();
       }
+
+      //Report late frames
+      printf( "Missed frames: %d\n", framePacer.getMissedFrames() );
+
+      //Dump frame times for comparing runs
+      std::vector<int> windows;
+      windows.push_back( FRAME_STATS_WINDOW );
+      windows.push_back( 0 );
+      frameStats.saveCSV( "Lesson_25/frame_times.csv" );
+      frameStats.saveJSON( "Lesson_25/frame_stats.json", windows );
     }
   }
 
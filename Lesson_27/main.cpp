@@ -3,6 +3,8 @@
 #include <SDL_image.h>
 #include <stdio.h>
 #include <string>
+#include <cmath>
+#include <algorithm>
 
 // Screen dimension constants
 const int SCREEN_WIDTH = 640;
@@ -17,8 +19,22 @@ bool loadMedia();
 // Frees media and shuts down SDL
 void close();
 
-// Box collision detector
-bool checkCollision(SDL_Rect a, SDL_Rect b);
+// Where a moving box first touches something
+struct SweepHit {
+  // Fraction of the move made before contact, 1 if nothing was hit
+  float time;
+
+  // Direction of the surface that was hit, 0 on the axis that wasn't blocked
+  int normalX, normalY;
+};
+
+// Gets when a box moving along one axis starts and stops overlapping a target
+// on that axis, false if it never does
+bool sweepAxis(int start, int size, float velocity, int targetStart,
+               int targetSize, float &entry, float &exit);
+
+// Gets when and how a box moving by (velX, velY) first touches another box
+SweepHit sweepBox(SDL_Rect box, float velX, float velY, SDL_Rect target);
 
 // Texture wrapper class
 class LTexture {
@@ -405,28 +421,51 @@ void Dot::handleEvent(SDL_Event &e) {
 }
 
 void Dot::move(SDL_Rect &wall) {
-  // Move the dot left or right
-  mPosX += mVelX;
-  mCollider.x = mPosX;
-
-  // If the dot collided or went too far to the left or right
-  if ((mPosX < 0) || (mPosX + DOT_WIDTH > SCREEN_WIDTH) || checkCollision(mCollider, wall))
-  {
-    // Move back
-    mPosX -= mVelX;
-    mCollider.x = mPosX;
-  }
-
-  // Move the dot up or down
-  mPosY += mVelY;
-  mCollider.y = mPosY;
+  // The wall and the screen edges, overlapping at the corners so nothing slips
+  // out diagonally
+  SDL_Rect walls[5] = {
+      wall,
+      {-DOT_WIDTH, -DOT_HEIGHT, DOT_WIDTH, SCREEN_HEIGHT + 2 * DOT_HEIGHT},
+      {SCREEN_WIDTH, -DOT_HEIGHT, DOT_WIDTH, SCREEN_HEIGHT + 2 * DOT_HEIGHT},
+      {-DOT_WIDTH, -DOT_HEIGHT, SCREEN_WIDTH + 2 * DOT_WIDTH, DOT_HEIGHT},
+      {-DOT_WIDTH, SCREEN_HEIGHT, SCREEN_WIDTH + 2 * DOT_WIDTH, DOT_HEIGHT}};
+
+  // Distance left to move
+  int moveX = mVelX;
+  int moveY = mVelY;
+
+  // Slide along walls, each pass blocks at least one axis
+  for (int pass = 0; pass < 3 && (moveX != 0 || moveY != 0); ++pass) {
+    // Keep the earliest contact
+    SweepHit hit = {1.f, 0, 0};
+    for (int i = 0; i < 5; ++i) {
+      SweepHit wallHit =
+          sweepBox(mCollider, (float)moveX, (float)moveY, walls[i]);
+      if (wallHit.time < hit.time) {
+        hit = wallHit;
+      }
+    }
 
-  // If the dot collided or went too far up or down
-  if ( ( mPosY < 0) || (mPosY + DOT_HEIGHT > SCREEN_HEIGHT) || checkCollision(mCollider, wall))
-  {
-    // Move back
-    mPosY -= mVelY;
+    // Walls sit on whole pixels, so the blocked axis rounds to the exact gap
+    // and the free axis rounds toward the start to stay out of walls
+    int stepX = hit.normalX != 0 ? (int)std::lround(moveX * hit.time)
+                                 : (int)(moveX * hit.time);
+    int stepY = hit.normalY != 0 ? (int)std::lround(moveY * hit.time)
+                                 : (int)(moveY * hit.time);
+    mPosX += stepX;
+    mPosY += stepY;
+    mCollider.x = mPosX;
     mCollider.y = mPosY;
+    moveX -= stepX;
+    moveY -= stepY;
+
+    // Stop moving into the wall
+    if (hit.normalX != 0) {
+      moveX = 0;
+    }
+    if (hit.normalY != 0) {
+      moveY = 0;
+    }
   }
 }
 
@@ -509,49 +548,55 @@ void close() {
   SDL_Quit();
 }
 
-bool checkCollision( SDL_Rect a, SDL_Rect b )
-{
-  //The sides of the reectangles
-  int leftA, leftB;
-  int rightA, rightB;
-  int topA, topB;
-  int bottomA, bottomB;
-
-  //Calculate the sides of rect A 
-  leftA = a.x;
-  rightA = a.x + a.w;
-  topA = a.y;
-  bottomA = a.y + a.h;
-
-  //Calculate the sides of rect B 
-  leftB = b.x;
-  rightB = b.x + b.w;
-  topB = b.y;
-  bottomB = b.y + b.h;
-
-  //If any of the sides from A are outside of B 
-  if( bottomA < topB )
-  {
-    return false;
+bool sweepAxis(int start, int size, float velocity, int targetStart,
+               int targetSize, float &entry, float &exit) {
+  // Not moving on this axis, so it either always or never overlaps
+  if (velocity == 0.f) {
+    if (start + size <= targetStart || start >= targetStart + targetSize) {
+      return false;
+    }
+    entry = -INFINITY;
+    exit = INFINITY;
+  } else if (velocity > 0.f) {
+    entry = (targetStart - (start + size)) / velocity;
+    exit = (targetStart + targetSize - start) / velocity;
+  } else {
+    entry = (targetStart + targetSize - start) / velocity;
+    exit = (targetStart - (start + size)) / velocity;
   }
 
-  if( topA >= bottomB )
-  {
-    return false;
+  return true;
+}
+
+SweepHit sweepBox(SDL_Rect box, float velX, float velY, SDL_Rect target) {
+  SweepHit hit = {1.f, 0, 0};
+
+  // When the box overlaps the target on each axis
+  float entryX, exitX, entryY, exitY;
+  if (!sweepAxis(box.x, box.w, velX, target.x, target.w, entryX, exitX) ||
+      !sweepAxis(box.y, box.h, velY, target.y, target.h, entryY, exitY)) {
+    return hit;
   }
 
-  if( rightA <= leftB )
-  {
-    return false;
+  // The boxes overlap once both axes do, until either stops
+  float entry = std::max(entryX, entryY);
+  float exit = std::min(exitX, exitY);
+
+  // Skip targets that are only grazed, already overlapped, or out of reach
+  // this move
+  if (entry >= exit || entry < 0.f || entry >= 1.f) {
+    return hit;
   }
 
-  if( leftA >= rightB )
-  {
-    return false;
+  // The axis that started overlapping last is the one that got blocked
+  hit.time = entry;
+  if (entryX > entryY) {
+    hit.normalX = velX > 0.f ? -1 : 1;
+  } else {
+    hit.normalY = velY > 0.f ? -1 : 1;
   }
 
-  //If none of the sides from A are outside B 
-  return true;
+  return hit;
 }
 
 int main(int argc, char *args[]) {
@@ -2,6 +2,7 @@
 #include <SDL.h>
 #include <SDL_image.h>
 #include <stdio.h>
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -18,8 +19,46 @@ bool loadMedia();
 // Frees media and shuts down SDL
 void close();
 
-// Box collision detector
-bool checkCollision(std::vector<SDL_Rect>& a, std::vector<SDL_Rect>& b);
+// A box of a composite collider, as edges relative to the body origin
+struct ColliderStrip {
+  int left, top, right, bottom;
+};
+
+// Body shape made of boxes stored once relative to the body origin
+class CompositeCollider {
+public:
+  // Initializes variables
+  CompositeCollider();
+
+  // Adds a box relative to the origin, keeping boxes sorted by top edge
+  void addStrip( int x, int y, int w, int h );
+
+  // Moves the body origin
+  void setPosition( int x, int y );
+
+  // Gets the body origin
+  int getX();
+  int getY();
+
+  // Gets the box enclosing all strips, relative to the origin
+  ColliderStrip& getBounds();
+
+  // Gets the strips sorted by top edge
+  std::vector<ColliderStrip>& getStrips();
+
+private:
+  // The body origin
+  int mPosX, mPosY;
+
+  // Enclosing box
+  ColliderStrip mBounds;
+
+  // Strips sorted by top edge
+  std::vector<ColliderStrip> mStrips;
+};
+
+// Composite collision detector
+bool checkCollision( CompositeCollider& a, CompositeCollider& b );
 
 // Texture wrapper class
 class LTexture {
@@ -115,13 +154,13 @@ public:
   void handleEvent(SDL_Event &e);
 
   // Moves the dot
-  void move( std::vector<SDL_Rect>& otherColliders );
+  void move( CompositeCollider& otherCollider );
 
   // Shows the dot on the screen
   void render();
 
   //Gets the collision boxes
-  std::vector<SDL_Rect>& getColliders();
+  CompositeCollider& getCollider();
 
 private:
   // The X and Y offsets of the dot
@@ -131,10 +170,7 @@ private:
   int mVelX, mVelY;
 
   // Dot's collision  boxes
-  std::vector<SDL_Rect> mColliders;
-
-  //Moves the collision boxes relative to the dot's offset 
-  void shiftColliders();
+  CompositeCollider mCollider;
 };
 
 // The window we'll be rendering to
@@ -358,54 +394,73 @@ bool LTimer::isPaused() {
   return mPaused && mStarted;
 }
 
-Dot::Dot( int x, int y ) {
-  // Initialize the offsets
-  mPosX = x;
-  mPosY = y;
+CompositeCollider::CompositeCollider() {
+  // Initialize
+  mPosX = 0;
+  mPosY = 0;
+  mBounds.left = 0;
+  mBounds.top = 0;
+  mBounds.right = 0;
+  mBounds.bottom = 0;
+}
 
-  //Crate the necessary SDL_Rects
-  mColliders.resize( 11 );
+void CompositeCollider::addStrip( int x, int y, int w, int h ) {
+  ColliderStrip strip = { x, y, x + w, y + h };
 
-  // Initialize the velocity
-  mVelX = 0;
-  mVelY = 0;
-
-  //Initialize the collision boxes' width and mHeight
-  mColliders[ 0 ].w = 6;
-  mColliders[ 0 ].h = 1;
+  // Grow the enclosing box
+  if( mStrips.empty() ) {
+    mBounds = strip;
+  } else {
+    mBounds.left = std::min( mBounds.left, strip.left );
+    mBounds.top = std::min( mBounds.top, strip.top );
+    mBounds.right = std::max( mBounds.right, strip.right );
+    mBounds.bottom = std::max( mBounds.bottom, strip.bottom );
+  }
 
-  mColliders[ 1 ].w = 10;
-  mColliders[ 1 ].h = 1;
+  // Insert after strips with the same or a higher top edge
+  std::vector<ColliderStrip>::iterator position = mStrips.begin();
+  while( position != mStrips.end() && position->top <= strip.top ) {
+    ++position;
+  }
+  mStrips.insert( position, strip );
+}
 
-  mColliders[ 2 ].w = 14;
-  mColliders[ 2 ].h = 1;
+void CompositeCollider::setPosition( int x, int y ) {
+  mPosX = x;
+  mPosY = y;
+}
 
-  mColliders[ 3 ].w = 16;
-  mColliders[ 3 ].h = 2;
+int CompositeCollider::getX() { return mPosX; }
 
-  mColliders[ 4 ].w = 18;
-  mColliders[ 4 ].h = 2;
+int CompositeCollider::getY() { return mPosY; }
 
-  mColliders[ 5 ].w = 20;
-  mColliders[ 5 ].h = 6;
+ColliderStrip& CompositeCollider::getBounds() { return mBounds; }
 
-  mColliders[ 6 ].w = 18;
-  mColliders[ 6 ].h = 2;
+std::vector<ColliderStrip>& CompositeCollider::getStrips() { return mStrips; }
 
-  mColliders[ 7 ].w = 16;
-  mColliders[ 7 ].h = 2;
+Dot::Dot( int x, int y ) {
+  // Initialize the offsets
+  mPosX = x;
+  mPosY = y;
 
-  mColliders[ 8 ].w = 14;
-  mColliders[ 8 ].h = 1;
+  // Initialize the velocity
+  mVelX = 0;
+  mVelY = 0;
 
-  mColliders[ 9 ].w = 10;
-  mColliders[ 9 ].h = 1;
+  //The collision boxes' width and height from top to bottom
+  const int widths[] = { 6, 10, 14, 16, 18, 20, 18, 16, 14, 10, 6 };
+  const int heights[] = { 1, 1, 1, 2, 2, 6, 2, 2, 1, 1, 1 };
 
-  mColliders[ 10 ].w = 6;
-  mColliders[ 10 ].h = 1;
+  //Stack the boxes centered under each other
+  int r = 0;
+  for( int set = 0; set < 11; ++set )
+  {
+    mCollider.addStrip( ( DOT_WIDTH - widths[ set ] ) / 2, r, widths[ set ], heights[ set ] );
+    r += heights[ set ];
+  }
 
-  //Initialize colliders relative to position
-  shiftColliders();
+  //Place colliders at the dot's offset
+  mCollider.setPosition( mPosX, mPosY );
 }
 
 void Dot::handleEvent(SDL_Event &e) {
@@ -447,54 +502,35 @@ void Dot::handleEvent(SDL_Event &e) {
   }
 }
 
-void Dot::move( std::vector<SDL_Rect>& otherColliders ) {
+void Dot::move( CompositeCollider& otherCollider ) {
   // Move the dot left or right
   mPosX += mVelX;
-  shiftColliders();
+  mCollider.setPosition( mPosX, mPosY );
 
   // If the dot collided or went too far to the left or right
-  if ((mPosX < 0) || (mPosX + DOT_WIDTH > SCREEN_WIDTH) || checkCollision(mColliders, otherColliders))
+  if ((mPosX < 0) || (mPosX + DOT_WIDTH > SCREEN_WIDTH) || checkCollision(mCollider, otherCollider))
   {
     // Move back
     mPosX -= mVelX;
-    shiftColliders();
+    mCollider.setPosition( mPosX, mPosY );
   }
 
   // Move the dot up or down
   mPosY += mVelY;
-  shiftColliders();
+  mCollider.setPosition( mPosX, mPosY );
 
   // If the dot collided or went too far up or down
-  if ( ( mPosY < 0) || (mPosY + DOT_HEIGHT > SCREEN_HEIGHT) || checkCollision(mColliders, otherColliders))
+  if ( ( mPosY < 0) || (mPosY + DOT_HEIGHT > SCREEN_HEIGHT) || checkCollision(mCollider, otherCollider))
   {
     // Move back
     mPosY -= mVelY;
-    shiftColliders();
-  }
-}
-
-void Dot::shiftColliders()
-{
-  //The row offset
-  int r = 0;
-
-  //Go through the dot's collision boxes
-  for( int set = 0; set < mColliders.size(); ++set )
-  {
-    //Center the collision boxes
-    mColliders[ set ].x = mPosX + ( DOT_WIDTH - mColliders[ set ].w ) / 2;
-
-    //Set the collision box at its row offset
-    mColliders[ set ].y = mPosY + r;
-
-    //Move the row offset down the height of the collision box
-    r += mColliders[ set ].h;
+    mCollider.setPosition( mPosX, mPosY );
   }
 }
 
-std::vector<SDL_Rect>& Dot::getColliders()
+CompositeCollider& Dot::getCollider()
 {
-  return mColliders;
+  return mCollider;
 }
 
 void Dot::render() {
@@ -576,40 +612,49 @@ void close() {
   SDL_Quit();
 }
 
-bool checkCollision( std::vector<SDL_Rect>& a, std::vector<SDL_Rect>& b )
+bool checkCollision( CompositeCollider& a, CompositeCollider& b )
 {
-  //The sides of the reectangles
-  int leftA, leftB;
-  int rightA, rightB;
-  int topA, topB;
-  int bottomA, bottomB;
-
-  //Go through the A boxes
-  for( int Abox = 0; Abox < a.size(); Abox++ )
+  //Offset of B's origin from A's, so strips compare without moving them
+  int offsetX = b.getX() - a.getX();
+  int offsetY = b.getY() - a.getY();
+
+  //If the enclosing boxes don't touch neither can the strips
+  ColliderStrip& boundsA = a.getBounds();
+  ColliderStrip& boundsB = b.getBounds();
+  if( boundsA.bottom <= boundsB.top + offsetY || boundsA.top >= boundsB.bottom + offsetY || boundsA.right <= boundsB.left + offsetX || boundsA.left >= boundsB.right + offsetX )
   {
-    //Calculate the sides of rect A
-    leftA = a[ Abox ].x;
-    rightA = a[ Abox ].x + a[ Abox ].w;
-    topA = a[ Abox ].y;
-    bottomA = a[ Abox ].y + a[ Abox ].h;
-
-    //Go through the B boxes
-    for( int Bbox = 0; Bbox < b.size(); Bbox++ )
+    return false;
+  }
+
+  //Only the rows both boxes share can collide
+  int overlapTop = std::max( boundsA.top, boundsB.top + offsetY );
+  int overlapBottom = std::min( boundsA.bottom, boundsB.bottom + offsetY );
+
+  //Go through the A strips in the shared rows
+  std::vector<ColliderStrip>& stripsA = a.getStrips();
+  std::vector<ColliderStrip>& stripsB = b.getStrips();
+  for( size_t Astrip = 0; Astrip < stripsA.size() && stripsA[ Astrip ].top < overlapBottom; ++Astrip )
+  {
+    ColliderStrip& stripA = stripsA[ Astrip ];
+    if( stripA.bottom <= overlapTop )
     {
-      //Calculate the sides of rect A
-      leftB = b[ Bbox ].x;
-      rightB = b[ Bbox ].x + b[ Bbox ].w;
-      topB = b[ Bbox ].y;
-      bottomB = b[ Bbox ].y + b[ Bbox ].h;
+      continue;
+    }
+
+    //Go through the B strips until they start below this A strip
+    for( size_t Bstrip = 0; Bstrip < stripsB.size() && stripsB[ Bstrip ].top + offsetY < stripA.bottom; ++Bstrip )
+    {
+      ColliderStrip& stripB = stripsB[ Bstrip ];
 
       //If no sides from A are outside B
-      if( ( ( bottomA <= topB ) || ( topA >= bottomB ) || ( rightA <= leftB ) || ( leftB >= rightB ) ) == false )
+      if( stripA.top < stripB.bottom + offsetY && stripA.right > stripB.left + offsetX && stripA.left < stripB.right + offsetX )
       {
         //A collision is detected
         return true;
       }
     }
   }
+
   //If neither set of collision boxes touched
   return false;
 }
@@ -649,7 +694,7 @@ int main(int argc, char *args[]) {
         }
 
         // Move the dot
-        dot.move( otherDot.getColliders() );
+        dot.move( otherDot.getCollider() );
 
         // Clear screen
         SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
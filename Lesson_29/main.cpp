@@ -3,13 +3,31 @@
 #include <SDL_image.h>
 #include <SDL_render.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
 #include <string>
 #include <vector>
 
+//Using SSE2 and AVX2 intrinsics on x86
+#if defined( __x86_64__ ) || defined( _M_X64 ) || defined( __i386__ ) || defined( _M_IX86 )
+#define COLLISION_SIMD_X86
+#include <immintrin.h>
+#endif
+
+//Lets GCC and Clang compile a function for an instruction set the rest of the program doesn't assume
+#if defined( __GNUC__ ) || defined( __clang__ )
+#define TARGET_ISA( isa ) __attribute__(( target( isa ) ))
+#else
+#define TARGET_ISA( isa )
+#endif
+
 // Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+//Batch tests clamp offsets to this so two squares still fit in an int, radii and their sums must stay below it
+const int COLLISION_OFFSET_LIMIT = 32767;
+
 //A circle structure
 struct Circle
 {
@@ -17,6 +35,28 @@ struct Circle
   int r;
 };
 
+//Shapes a collision body can have
+const int BODY_CIRCLE = 0;
+const int BODY_BOX = 1;
+
+//Two bodies that touch, lower id first
+struct CollisionPair
+{
+  int a, b;
+};
+
+//Boxes stored as parallel arrays so batch tests read them sequentially
+struct BoxArray
+{
+  std::vector<int> x, y, w, h;
+};
+
+//Circles stored as parallel arrays so batch tests read them sequentially
+struct CircleArray
+{
+  std::vector<int> x, y, r;
+};
+
 // Starts up SDL and creates window
 bool init();
 
@@ -32,9 +72,46 @@ bool checkCollision( Circle& a, Circle& b );
 //Circle/Box collision detector
 bool checkCollision( Circle& a, SDL_Rect& b );
 
+//Box/Box collision detector
+bool checkCollision( SDL_Rect& a, SDL_Rect& b );
+
 //Calculates distance squared between two points
 double distanceSquared( int x1, int y1, int x2, int y2 );
 
+//Circle/Boxes batch collision detector, sets hits[ i ] to 1 for each box touched and returns how many were
+int checkCollision( Circle& a, BoxArray& b, std::vector<Uint8>& hits );
+
+//Circle/Circles batch collision detector, sets hits[ i ] to 1 for each circle touched and returns how many were
+int checkCollision( Circle& a, CircleArray& b, std::vector<Uint8>& hits );
+
+//Tests one circle against count boxes given as parallel arrays
+typedef int ( *CircleBoxKernel )( Circle& a, const int* x, const int* y, const int* w, const int* h, int count, Uint8* hits );
+
+//Tests one circle against count circles given as parallel arrays
+typedef int ( *CircleCircleKernel )( Circle& a, const int* x, const int* y, const int* r, int count, Uint8* hits );
+
+//Portable batch tests
+int checkCircleBoxesScalar( Circle& a, const int* x, const int* y, const int* w, const int* h, int count, Uint8* hits );
+int checkCircleCirclesScalar( Circle& a, const int* x, const int* y, const int* r, int count, Uint8* hits );
+
+#if defined( COLLISION_SIMD_X86 )
+//Batch tests 8 shapes at a time
+int checkCircleBoxesSSE2( Circle& a, const int* x, const int* y, const int* w, const int* h, int count, Uint8* hits );
+int checkCircleBoxesAVX2( Circle& a, const int* x, const int* y, const int* w, const int* h, int count, Uint8* hits );
+int checkCircleCirclesSSE2( Circle& a, const int* x, const int* y, const int* r, int count, Uint8* hits );
+int checkCircleCirclesAVX2( Circle& a, const int* x, const int* y, const int* r, int count, Uint8* hits );
+#endif
+
+//Gets the fastest batch tests this CPU supports
+CircleBoxKernel getCircleBoxKernel();
+CircleCircleKernel getCircleCircleKernel();
+
+//Times the batch collision kernels against one pair at a time
+void benchmarkCollisionKernels();
+
+//Times the collision world with many moving bodies
+void benchmarkCollisionWorld();
+
 
 // Texture wrapper class
 class LTexture {
@@ -152,6 +229,65 @@ private:
   void shiftColliders();
 };
 
+// Bodies that register their shapes and get back the pairs that touch
+//
+// The broad phase keeps the bodies sorted by the left edge of their bounding
+// box. Bodies move a little each step, so the order is repaired with an
+// insertion sort and then swept once, pairing each body only with the ones
+// that start before it ends. Candidate pairs go through checkCollision.
+class CollisionWorld {
+public:
+  // Initializes variables
+  CollisionWorld();
+
+  // Adds a body, returning its id
+  int addBody( Circle& circle );
+  int addBody( SDL_Rect& box );
+
+  // Updates a body's shape after it moved
+  void moveBody( int body, Circle& circle );
+  void moveBody( int body, SDL_Rect& box );
+
+  // Removes all bodies
+  void clear();
+
+  // Gets the number of bodies
+  int getBodyCount();
+
+  // Finds the pairs of bodies whose bounding boxes overlap
+  void findCandidates( std::vector<CollisionPair>& pairs );
+
+  // Finds the pairs of bodies whose shapes overlap
+  void findContacts( std::vector<CollisionPair>& contacts );
+
+private:
+  // Sets a body's bounding box
+  void setBounds( int body, int left, int top, int right, int bottom );
+
+  // Runs the narrow phase test for two bodies
+  bool checkShapes( int a, int b );
+
+  // Shape of each body, only the one matching its type is used
+  std::vector<int> mTypes;
+  std::vector<Circle> mCircles;
+  std::vector<SDL_Rect> mBoxes;
+
+  // Bounding box edges of each body
+  std::vector<int> mLeft, mTop, mRight, mBottom;
+
+  // Body ids sorted by left edge
+  std::vector<int> mOrder;
+
+  // Bounding box edges in sorted order so the sweep reads them sequentially
+  std::vector<int> mSortedLeft, mSortedTop, mSortedRight, mSortedBottom;
+
+  // Whether bodies were added since the last sort
+  bool mNeedsFullSort;
+
+  // Scratch candidate list for the narrow phase
+  std::vector<CollisionPair> mCandidates;
+};
+
 // The window we'll be rendering to
 SDL_Window *gWindow = NULL;
 
@@ -471,6 +607,158 @@ void Dot::render() {
   gDotTexture.render(mPosX - mCollider.r, mPosY - mCollider.r );
 }
 
+CollisionWorld::CollisionWorld() {
+  // Initialize
+  mNeedsFullSort = false;
+}
+
+int CollisionWorld::addBody( Circle& circle ) {
+  // Grow every table by one body
+  int body = mTypes.size();
+  mTypes.push_back( BODY_CIRCLE );
+  mCircles.push_back( circle );
+  mBoxes.push_back( SDL_Rect() );
+  mLeft.push_back( 0 );
+  mTop.push_back( 0 );
+  mRight.push_back( 0 );
+  mBottom.push_back( 0 );
+  mOrder.push_back( body );
+  mNeedsFullSort = true;
+
+  moveBody( body, circle );
+  return body;
+}
+
+int CollisionWorld::addBody( SDL_Rect& box ) {
+  // Grow every table by one body
+  int body = mTypes.size();
+  mTypes.push_back( BODY_BOX );
+  mCircles.push_back( Circle() );
+  mBoxes.push_back( box );
+  mLeft.push_back( 0 );
+  mTop.push_back( 0 );
+  mRight.push_back( 0 );
+  mBottom.push_back( 0 );
+  mOrder.push_back( body );
+  mNeedsFullSort = true;
+
+  moveBody( body, box );
+  return body;
+}
+
+void CollisionWorld::moveBody( int body, Circle& circle ) {
+  mCircles[ body ] = circle;
+  setBounds( body, circle.x - circle.r, circle.y - circle.r, circle.x + circle.r, circle.y + circle.r );
+}
+
+void CollisionWorld::moveBody( int body, SDL_Rect& box ) {
+  mBoxes[ body ] = box;
+  setBounds( body, box.x, box.y, box.x + box.w, box.y + box.h );
+}
+
+void CollisionWorld::setBounds( int body, int left, int top, int right, int bottom ) {
+  mLeft[ body ] = left;
+  mTop[ body ] = top;
+  mRight[ body ] = right;
+  mBottom[ body ] = bottom;
+}
+
+void CollisionWorld::clear() {
+  mTypes.clear();
+  mCircles.clear();
+  mBoxes.clear();
+  mLeft.clear();
+  mTop.clear();
+  mRight.clear();
+  mBottom.clear();
+  mOrder.clear();
+  mNeedsFullSort = false;
+}
+
+int CollisionWorld::getBodyCount() {
+  return mTypes.size();
+}
+
+void CollisionWorld::findCandidates( std::vector<CollisionPair>& pairs ) {
+  pairs.clear();
+  int count = mOrder.size();
+
+  // New bodies are out of place anywhere, so sort from scratch
+  if( mNeedsFullSort ) {
+    std::sort( mOrder.begin(), mOrder.end(), [ this ]( int a, int b ) { return mLeft[ a ] < mLeft[ b ]; } );
+    mNeedsFullSort = false;
+  }
+  // Otherwise bodies only moved a little since last step
+  else {
+    for( int i = 1; i < count; ++i ) {
+      int body = mOrder[ i ];
+      int left = mLeft[ body ];
+      int j = i - 1;
+      while( j >= 0 && mLeft[ mOrder[ j ] ] > left ) {
+        mOrder[ j + 1 ] = mOrder[ j ];
+        --j;
+      }
+      mOrder[ j + 1 ] = body;
+    }
+  }
+
+  // Gather bounds in sweep order
+  mSortedLeft.resize( count );
+  mSortedTop.resize( count );
+  mSortedRight.resize( count );
+  mSortedBottom.resize( count );
+  for( int i = 0; i < count; ++i ) {
+    int body = mOrder[ i ];
+    mSortedLeft[ i ] = mLeft[ body ];
+    mSortedTop[ i ] = mTop[ body ];
+    mSortedRight[ i ] = mRight[ body ];
+    mSortedBottom[ i ] = mBottom[ body ];
+  }
+
+  // Pair each body with the following ones that start before it ends
+  for( int i = 0; i < count; ++i ) {
+    int right = mSortedRight[ i ];
+    int top = mSortedTop[ i ];
+    int bottom = mSortedBottom[ i ];
+    for( int j = i + 1; j < count && mSortedLeft[ j ] <= right; ++j ) {
+      // Edges that only touch still count, the narrow phase decides
+      if( mSortedTop[ j ] <= bottom && top <= mSortedBottom[ j ] ) {
+        CollisionPair pair;
+        pair.a = std::min( mOrder[ i ], mOrder[ j ] );
+        pair.b = std::max( mOrder[ i ], mOrder[ j ] );
+        pairs.push_back( pair );
+      }
+    }
+  }
+}
+
+void CollisionWorld::findContacts( std::vector<CollisionPair>& contacts ) {
+  // Broad phase
+  findCandidates( mCandidates );
+
+  // Narrow phase
+  contacts.clear();
+  for( size_t i = 0; i < mCandidates.size(); ++i ) {
+    if( checkShapes( mCandidates[ i ].a, mCandidates[ i ].b ) ) {
+      contacts.push_back( mCandidates[ i ] );
+    }
+  }
+}
+
+bool CollisionWorld::checkShapes( int a, int b ) {
+  if( mTypes[ a ] == BODY_CIRCLE ) {
+    if( mTypes[ b ] == BODY_CIRCLE ) {
+      return checkCollision( mCircles[ a ], mCircles[ b ] );
+    }
+    return checkCollision( mCircles[ a ], mBoxes[ b ] );
+  }
+
+  if( mTypes[ b ] == BODY_CIRCLE ) {
+    return checkCollision( mCircles[ b ], mBoxes[ a ] );
+  }
+  return checkCollision( mBoxes[ a ], mBoxes[ b ] );
+}
+
 bool init() {
   // Initialization flag
   bool success = true;
@@ -606,14 +894,572 @@ bool checkCollision( Circle& a, SDL_Rect& b )
   return false;
 }
 
+bool checkCollision( SDL_Rect& a, SDL_Rect& b )
+{
+  //The sides of the rectangles
+  int leftA, leftB;
+  int rightA, rightB;
+  int topA, topB;
+  int bottomA, bottomB;
+
+  //Calculate the sides of rect A
+  leftA = a.x;
+  rightA = a.x + a.w;
+  topA = a.y;
+  bottomA = a.y + a.h;
+
+  //Calculate the sides of rect B
+  leftB = b.x;
+  rightB = b.x + b.w;
+  topB = b.y;
+  bottomB = b.y + b.h;
+
+  //If any of the sides from A are outside of B
+  if( bottomA <= topB )
+  {
+    return false;
+  }
+
+  if( topA >= bottomB )
+  {
+    return false;
+  }
+
+  if( rightA <= leftB )
+  {
+    return false;
+  }
+
+  if( leftA >= rightB )
+  {
+    return false;
+  }
+
+  //If none of the sides from A are outside B
+  return true;
+}
+
 double distanceSquared( int x1, int y1, int x2, int y2 )
 {
-  int deltaX = x2 - x1;
-  int deltaY = y2 - y1;
+  double deltaX = x2 - x1;
+  double deltaY = y2 - y1;
   return deltaX*deltaX + deltaY*deltaY;
 }
 
+int checkCollision( Circle& a, BoxArray& b, std::vector<Uint8>& hits )
+{
+  //Pick the kernel once
+  static CircleBoxKernel kernel = getCircleBoxKernel();
+
+  int count = b.x.size();
+  hits.resize( count );
+  if( count == 0 )
+  {
+    return 0;
+  }
+
+  return kernel( a, &b.x[ 0 ], &b.y[ 0 ], &b.w[ 0 ], &b.h[ 0 ], count, &hits[ 0 ] );
+}
+
+int checkCollision( Circle& a, CircleArray& b, std::vector<Uint8>& hits )
+{
+  //Pick the kernel once
+  static CircleCircleKernel kernel = getCircleCircleKernel();
+
+  int count = b.x.size();
+  hits.resize( count );
+  if( count == 0 )
+  {
+    return 0;
+  }
+
+  return kernel( a, &b.x[ 0 ], &b.y[ 0 ], &b.r[ 0 ], count, &hits[ 0 ] );
+}
+
+//Anything clamped is farther than any radius reaches, so hits don't change
+static inline int clampOffset( int offset )
+{
+  return std::max( -COLLISION_OFFSET_LIMIT, std::min( offset, COLLISION_OFFSET_LIMIT ) );
+}
+
+int checkCircleBoxesScalar( Circle& a, const int* x, const int* y, const int* w, const int* h, int count, Uint8* hits )
+{
+  int total = 0;
+  int radiusSquared = a.r * a.r;
+  for( int i = 0; i < count; ++i )
+  {
+    //Offset from the circle to the closest point on the box
+    int left = x[ i ] - a.x;
+    int top = y[ i ] - a.y;
+    int deltaX = clampOffset( std::max( left, std::min( left + w[ i ], 0 ) ) );
+    int deltaY = clampOffset( std::max( top, std::min( top + h[ i ], 0 ) ) );
+
+    //If the closest point is inside the circle
+    hits[ i ] = deltaX * deltaX + deltaY * deltaY < radiusSquared;
+    total += hits[ i ];
+  }
+
+  return total;
+}
+
+int checkCircleCirclesScalar( Circle& a, const int* x, const int* y, const int* r, int count, Uint8* hits )
+{
+  int total = 0;
+  for( int i = 0; i < count; ++i )
+  {
+    //If the distance between the centers is less than the sum of the radii
+    int deltaX = clampOffset( x[ i ] - a.x );
+    int deltaY = clampOffset( y[ i ] - a.y );
+    int totalRadius = a.r + r[ i ];
+    hits[ i ] = deltaX * deltaX + deltaY * deltaY < totalRadius * totalRadius;
+    total += hits[ i ];
+  }
+
+  return total;
+}
+
+#if defined( COLLISION_SIMD_X86 )
+//SSE2 has no 32 bit multiply, so offsets are clamped to 16 bits and squared and summed by madd.
+//Saturating alone would let two -32768s sum to 2^31 and wrap negative, so the low end stops at -32767 like the other kernels.
+TARGET_ISA( "sse2" ) static inline __m128i distanceSquaredSSE2( __m128i deltaX, __m128i deltaY )
+{
+  __m128i packed = _mm_max_epi16( _mm_packs_epi32( deltaX, deltaY ), _mm_set1_epi16( -COLLISION_OFFSET_LIMIT ) );
+  __m128i pairs = _mm_unpacklo_epi16( packed, _mm_srli_si128( packed, 8 ) );
+  return _mm_madd_epi16( pairs, pairs );
+}
+
+//Clamps 0 to [ low, high ] without SSE4.1 min and max
+TARGET_ISA( "sse2" ) static inline __m128i closestOffsetSSE2( __m128i low, __m128i high )
+{
+  __m128i belowZero = _mm_and_si128( high, _mm_srai_epi32( high, 31 ) );
+  __m128i aboveZero = _mm_cmpgt_epi32( low, _mm_setzero_si128() );
+  return _mm_or_si128( _mm_and_si128( aboveZero, low ), _mm_andnot_si128( aboveZero, belowZero ) );
+}
+
+//Stores 8 lane masks as 0 or 1 bytes
+TARGET_ISA( "sse2" ) static inline void storeHitsSSE2( Uint8* hits, __m128i low, __m128i high )
+{
+  __m128i bytes = _mm_packs_epi16( _mm_packs_epi32( low, high ), _mm_setzero_si128() );
+  _mm_storel_epi64( (__m128i*)hits, _mm_and_si128( bytes, _mm_set1_epi8( 1 ) ) );
+}
+
+//Adds up the lanes of a hit counter
+TARGET_ISA( "sse2" ) static inline int sumLanesSSE2( __m128i lanes )
+{
+  int sums[ 4 ];
+  _mm_storeu_si128( (__m128i*)sums, lanes );
+  return sums[ 0 ] + sums[ 1 ] + sums[ 2 ] + sums[ 3 ];
+}
+
+TARGET_ISA( "sse2" ) int checkCircleBoxesSSE2( Circle& a, const int* x, const int* y, const int* w, const int* h, int count, Uint8* hits )
+{
+  __m128i circleX = _mm_set1_epi32( a.x );
+  __m128i circleY = _mm_set1_epi32( a.y );
+  __m128i radiusSquared = _mm_set1_epi32( a.r * a.r );
+  __m128i hitLanes = _mm_setzero_si128();
+
+  int i = 0;
+  for( ; i + 8 <= count; i += 8 )
+  {
+    //Two groups of four
+    __m128i hit[ 2 ];
+    for( int group = 0; group < 2; ++group )
+    {
+      int j = i + group * 4;
+      __m128i left = _mm_sub_epi32( _mm_loadu_si128( (__m128i*)( x + j ) ), circleX );
+      __m128i top = _mm_sub_epi32( _mm_loadu_si128( (__m128i*)( y + j ) ), circleY );
+      __m128i deltaX = closestOffsetSSE2( left, _mm_add_epi32( left, _mm_loadu_si128( (__m128i*)( w + j ) ) ) );
+      __m128i deltaY = closestOffsetSSE2( top, _mm_add_epi32( top, _mm_loadu_si128( (__m128i*)( h + j ) ) ) );
+      hit[ group ] = _mm_cmplt_epi32( distanceSquaredSSE2( deltaX, deltaY ), radiusSquared );
+
+      //Hit lanes compare to -1, so subtracting counts them
+      hitLanes = _mm_sub_epi32( hitLanes, hit[ group ] );
+    }
+    storeHitsSSE2( hits + i, hit[ 0 ], hit[ 1 ] );
+  }
+
+  //Finish the tail
+  return sumLanesSSE2( hitLanes ) + checkCircleBoxesScalar( a, x + i, y + i, w + i, h + i, count - i, hits + i );
+}
+
+TARGET_ISA( "sse2" ) int checkCircleCirclesSSE2( Circle& a, const int* x, const int* y, const int* r, int count, Uint8* hits )
+{
+  __m128i circleX = _mm_set1_epi32( a.x );
+  __m128i circleY = _mm_set1_epi32( a.y );
+  __m128i circleR = _mm_set1_epi32( a.r );
+  __m128i hitLanes = _mm_setzero_si128();
+
+  int i = 0;
+  for( ; i + 8 <= count; i += 8 )
+  {
+    //Two groups of four
+    __m128i hit[ 2 ];
+    for( int group = 0; group < 2; ++group )
+    {
+      int j = i + group * 4;
+      __m128i deltaX = _mm_sub_epi32( _mm_loadu_si128( (__m128i*)( x + j ) ), circleX );
+      __m128i deltaY = _mm_sub_epi32( _mm_loadu_si128( (__m128i*)( y + j ) ), circleY );
+      __m128i totalRadius = _mm_add_epi32( _mm_loadu_si128( (__m128i*)( r + j ) ), circleR );
+      __m128i totalRadiusSquared = distanceSquaredSSE2( totalRadius, _mm_setzero_si128() );
+      hit[ group ] = _mm_cmplt_epi32( distanceSquaredSSE2( deltaX, deltaY ), totalRadiusSquared );
+
+      //Hit lanes compare to -1, so subtracting counts them
+      hitLanes = _mm_sub_epi32( hitLanes, hit[ group ] );
+    }
+    storeHitsSSE2( hits + i, hit[ 0 ], hit[ 1 ] );
+  }
+
+  //Finish the tail
+  return sumLanesSSE2( hitLanes ) + checkCircleCirclesScalar( a, x + i, y + i, r + i, count - i, hits + i );
+}
+
+//Stores 8 lane masks as 0 or 1 bytes
+TARGET_ISA( "avx2" ) static inline void storeHitsAVX2( Uint8* hits, __m256i hit )
+{
+  __m128i words = _mm_packs_epi32( _mm256_castsi256_si128( hit ), _mm256_extracti128_si256( hit, 1 ) );
+  __m128i bytes = _mm_packs_epi16( words, _mm_setzero_si128() );
+  _mm_storel_epi64( (__m128i*)hits, _mm_and_si128( bytes, _mm_set1_epi8( 1 ) ) );
+}
+
+//Adds up the lanes of a hit counter
+TARGET_ISA( "avx2" ) static inline int sumLanesAVX2( __m256i lanes )
+{
+  __m128i sums = _mm_add_epi32( _mm256_castsi256_si128( lanes ), _mm256_extracti128_si256( lanes, 1 ) );
+  sums = _mm_add_epi32( sums, _mm_shuffle_epi32( sums, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+  sums = _mm_add_epi32( sums, _mm_shuffle_epi32( sums, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+  return _mm_cvtsi128_si32( sums );
+}
+
+//Keeps the squares from overflowing like the scalar kernels
+TARGET_ISA( "avx2" ) static inline __m256i clampOffsetAVX2( __m256i offset )
+{
+  __m256i limit = _mm256_set1_epi32( COLLISION_OFFSET_LIMIT );
+  return _mm256_max_epi32( _mm256_sub_epi32( _mm256_setzero_si256(), limit ), _mm256_min_epi32( offset, limit ) );
+}
+
+TARGET_ISA( "avx2" ) int checkCircleBoxesAVX2( Circle& a, const int* x, const int* y, const int* w, const int* h, int count, Uint8* hits )
+{
+  __m256i zero = _mm256_setzero_si256();
+  __m256i circleX = _mm256_set1_epi32( a.x );
+  __m256i circleY = _mm256_set1_epi32( a.y );
+  __m256i radiusSquared = _mm256_set1_epi32( a.r * a.r );
+  __m256i hitLanes = zero;
+
+  int i = 0;
+  for( ; i + 8 <= count; i += 8 )
+  {
+    //Offset from the circle to the closest point on eight boxes
+    __m256i left = _mm256_sub_epi32( _mm256_loadu_si256( (__m256i*)( x + i ) ), circleX );
+    __m256i top = _mm256_sub_epi32( _mm256_loadu_si256( (__m256i*)( y + i ) ), circleY );
+    __m256i right = _mm256_add_epi32( left, _mm256_loadu_si256( (__m256i*)( w + i ) ) );
+    __m256i bottom = _mm256_add_epi32( top, _mm256_loadu_si256( (__m256i*)( h + i ) ) );
+    __m256i deltaX = clampOffsetAVX2( _mm256_max_epi32( left, _mm256_min_epi32( right, zero ) ) );
+    __m256i deltaY = clampOffsetAVX2( _mm256_max_epi32( top, _mm256_min_epi32( bottom, zero ) ) );
+
+    //If the closest point is inside the circle
+    __m256i distance = _mm256_add_epi32( _mm256_mullo_epi32( deltaX, deltaX ), _mm256_mullo_epi32( deltaY, deltaY ) );
+    __m256i hit = _mm256_cmpgt_epi32( radiusSquared, distance );
+    storeHitsAVX2( hits + i, hit );
+
+    //Hit lanes compare to -1, so subtracting counts them
+    hitLanes = _mm256_sub_epi32( hitLanes, hit );
+  }
+
+  //Finish the tail
+  return sumLanesAVX2( hitLanes ) + checkCircleBoxesScalar( a, x + i, y + i, w + i, h + i, count - i, hits + i );
+}
+
+TARGET_ISA( "avx2" ) int checkCircleCirclesAVX2( Circle& a, const int* x, const int* y, const int* r, int count, Uint8* hits )
+{
+  __m256i circleX = _mm256_set1_epi32( a.x );
+  __m256i circleY = _mm256_set1_epi32( a.y );
+  __m256i circleR = _mm256_set1_epi32( a.r );
+  __m256i hitLanes = _mm256_setzero_si256();
+
+  int i = 0;
+  for( ; i + 8 <= count; i += 8 )
+  {
+    //If the distance between the centers is less than the sum of the radii
+    __m256i deltaX = clampOffsetAVX2( _mm256_sub_epi32( _mm256_loadu_si256( (__m256i*)( x + i ) ), circleX ) );
+    __m256i deltaY = clampOffsetAVX2( _mm256_sub_epi32( _mm256_loadu_si256( (__m256i*)( y + i ) ), circleY ) );
+    __m256i totalRadius = _mm256_add_epi32( _mm256_loadu_si256( (__m256i*)( r + i ) ), circleR );
+    __m256i distance = _mm256_add_epi32( _mm256_mullo_epi32( deltaX, deltaX ), _mm256_mullo_epi32( deltaY, deltaY ) );
+    __m256i hit = _mm256_cmpgt_epi32( _mm256_mullo_epi32( totalRadius, totalRadius ), distance );
+    storeHitsAVX2( hits + i, hit );
+
+    //Hit lanes compare to -1, so subtracting counts them
+    hitLanes = _mm256_sub_epi32( hitLanes, hit );
+  }
+
+  //Finish the tail
+  return sumLanesAVX2( hitLanes ) + checkCircleCirclesScalar( a, x + i, y + i, r + i, count - i, hits + i );
+}
+#endif
+
+CircleBoxKernel getCircleBoxKernel()
+{
+  #if defined( COLLISION_SIMD_X86 )
+  if( SDL_HasAVX2() )
+  {
+    return checkCircleBoxesAVX2;
+  }
+  if( SDL_HasSSE2() )
+  {
+    return checkCircleBoxesSSE2;
+  }
+  #endif
+
+  return checkCircleBoxesScalar;
+}
+
+CircleCircleKernel getCircleCircleKernel()
+{
+  #if defined( COLLISION_SIMD_X86 )
+  if( SDL_HasAVX2() )
+  {
+    return checkCircleCirclesAVX2;
+  }
+  if( SDL_HasSSE2() )
+  {
+    return checkCircleCirclesSSE2;
+  }
+  #endif
+
+  return checkCircleCirclesScalar;
+}
+
+void benchmarkCollisionKernels()
+{
+  //Projectiles against a field of boxes and circles
+  const int SHAPE_COUNT = 100000;
+  const int PROJECTILES = 200;
+
+  srand( 2 );
+  BoxArray boxes;
+  CircleArray circles;
+  std::vector<SDL_Rect> boxList( SHAPE_COUNT );
+  std::vector<Circle> circleList( SHAPE_COUNT );
+  for( int i = 0; i < SHAPE_COUNT; ++i )
+  {
+    SDL_Rect box = { rand() % SCREEN_WIDTH, rand() % SCREEN_HEIGHT, 1 + rand() % 40, 1 + rand() % 40 };
+    boxList[ i ] = box;
+    boxes.x.push_back( box.x );
+    boxes.y.push_back( box.y );
+    boxes.w.push_back( box.w );
+    boxes.h.push_back( box.h );
+
+    Circle circle = { rand() % SCREEN_WIDTH, rand() % SCREEN_HEIGHT, 1 + rand() % 20 };
+    circleList[ i ] = circle;
+    circles.x.push_back( circle.x );
+    circles.y.push_back( circle.y );
+    circles.r.push_back( circle.r );
+  }
+  std::vector<Circle> projectiles( PROJECTILES );
+  for( int i = 0; i < PROJECTILES; ++i )
+  {
+    Circle projectile = { rand() % SCREEN_WIDTH, rand() % SCREEN_HEIGHT, 1 + rand() % 10 };
+    projectiles[ i ] = projectile;
+  }
+
+  //One pair at a time
+  long long pairHits = 0;
+  Uint64 start = SDL_GetPerformanceCounter();
+  for( int p = 0; p < PROJECTILES; ++p )
+  {
+    for( int i = 0; i < SHAPE_COUNT; ++i )
+    {
+      pairHits += checkCollision( projectiles[ p ], boxList[ i ] );
+      pairHits += checkCollision( projectiles[ p ], circleList[ i ] );
+    }
+  }
+  double pairTime = (double)( SDL_GetPerformanceCounter() - start ) * 1000.0 / SDL_GetPerformanceFrequency();
+  printf( "%d projectiles x %d boxes and circles, one pair at a time: %.2f ms (%lld hits)\n", PROJECTILES, SHAPE_COUNT, pairTime, pairHits );
+
+  //Kernels to compare
+  std::vector<CircleBoxKernel> boxKernels;
+  std::vector<CircleCircleKernel> circleKernels;
+  std::vector<std::string> names;
+  boxKernels.push_back( checkCircleBoxesScalar );
+  circleKernels.push_back( checkCircleCirclesScalar );
+  names.push_back( "scalar" );
+  #if defined( COLLISION_SIMD_X86 )
+  if( SDL_HasSSE2() )
+  {
+    boxKernels.push_back( checkCircleBoxesSSE2 );
+    circleKernels.push_back( checkCircleCirclesSSE2 );
+    names.push_back( "SSE2" );
+  }
+  if( SDL_HasAVX2() )
+  {
+    boxKernels.push_back( checkCircleBoxesAVX2 );
+    circleKernels.push_back( checkCircleCirclesAVX2 );
+    names.push_back( "AVX2" );
+  }
+  #endif
+
+  //Shapes far apart must not wrap around into hits, whatever the kernel
+  const int FAR_COUNT = 64;
+  BoxArray farBoxes;
+  CircleArray farCircles;
+  std::vector<SDL_Rect> farBoxList( FAR_COUNT );
+  std::vector<Circle> farCircleList( FAR_COUNT );
+  for( int i = 0; i < FAR_COUNT; ++i )
+  {
+    SDL_Rect box = { rand() % 160000 - 80000, rand() % 160000 - 80000, 1 + rand() % 40, 1 + rand() % 40 };
+    Circle circle = { rand() % 160000 - 80000, rand() % 160000 - 80000, 1 + rand() % 20 };
+    if( i % 8 == 0 )
+    {
+      //A few right on top of the origin
+      box.x = box.y = circle.x = circle.y = 0;
+    }
+    farBoxList[ i ] = box;
+    farBoxes.x.push_back( box.x );
+    farBoxes.y.push_back( box.y );
+    farBoxes.w.push_back( box.w );
+    farBoxes.h.push_back( box.h );
+    farCircleList[ i ] = circle;
+    farCircles.x.push_back( circle.x );
+    farCircles.y.push_back( circle.y );
+    farCircles.r.push_back( circle.r );
+  }
+  Circle farProjectiles[] = { { 40000, 40000, 10 }, { -40000, -40000, 10 }, { 0, 0, 10 }, { -50000, 60000, 20 } };
+  std::vector<Uint8> farHits( FAR_COUNT );
+  for( size_t k = 0; k < names.size(); ++k )
+  {
+    int mismatches = 0;
+    for( int p = 0; p < 4; ++p )
+    {
+      boxKernels[ k ]( farProjectiles[ p ], &farBoxes.x[ 0 ], &farBoxes.y[ 0 ], &farBoxes.w[ 0 ], &farBoxes.h[ 0 ], FAR_COUNT, &farHits[ 0 ] );
+      for( int i = 0; i < FAR_COUNT; ++i )
+      {
+        mismatches += farHits[ i ] != checkCollision( farProjectiles[ p ], farBoxList[ i ] );
+      }
+      circleKernels[ k ]( farProjectiles[ p ], &farCircles.x[ 0 ], &farCircles.y[ 0 ], &farCircles.r[ 0 ], FAR_COUNT, &farHits[ 0 ] );
+      for( int i = 0; i < FAR_COUNT; ++i )
+      {
+        mismatches += farHits[ i ] != checkCollision( farProjectiles[ p ], farCircleList[ i ] );
+      }
+    }
+    printf( "%s batch against far apart shapes: %d mismatches with one pair at a time\n", names[ k ].c_str(), mismatches );
+  }
+
+  std::vector<Uint8> hits( SHAPE_COUNT );
+  for( size_t k = 0; k < names.size(); ++k )
+  {
+    long long batchHits = 0;
+    start = SDL_GetPerformanceCounter();
+    for( int p = 0; p < PROJECTILES; ++p )
+    {
+      batchHits += boxKernels[ k ]( projectiles[ p ], &boxes.x[ 0 ], &boxes.y[ 0 ], &boxes.w[ 0 ], &boxes.h[ 0 ], SHAPE_COUNT, &hits[ 0 ] );
+      batchHits += circleKernels[ k ]( projectiles[ p ], &circles.x[ 0 ], &circles.y[ 0 ], &circles.r[ 0 ], SHAPE_COUNT, &hits[ 0 ] );
+    }
+    double batchTime = (double)( SDL_GetPerformanceCounter() - start ) * 1000.0 / SDL_GetPerformanceFrequency();
+    printf( "%d projectiles x %d boxes and circles, %s batch: %.2f ms (%lld hits)\n", PROJECTILES, SHAPE_COUNT, names[ k ].c_str(), batchTime, batchHits );
+  }
+}
+
+void benchmarkCollisionWorld()
+{
+  //Dots wandering a field 20 screens big, every tenth one a box
+  const int BODY_COUNT = 10000;
+  const int FIELD_WIDTH = SCREEN_WIDTH * 5;
+  const int FIELD_HEIGHT = SCREEN_HEIGHT * 4;
+  const int STEPS = 600;
+
+  srand( 1 );
+  std::vector<Circle> circles( BODY_COUNT );
+  std::vector<SDL_Rect> boxes( BODY_COUNT );
+  std::vector<int> velX( BODY_COUNT ), velY( BODY_COUNT );
+  CollisionWorld world;
+  for( int i = 0; i < BODY_COUNT; ++i )
+  {
+    velX[ i ] = rand() % 7 - 3;
+    velY[ i ] = rand() % 7 - 3;
+    if( i % 10 == 0 )
+    {
+      SDL_Rect box = { rand() % ( FIELD_WIDTH - Dot::DOT_WIDTH ), rand() % ( FIELD_HEIGHT - Dot::DOT_HEIGHT ), Dot::DOT_WIDTH, Dot::DOT_HEIGHT };
+      boxes[ i ] = box;
+      world.addBody( boxes[ i ] );
+    }
+    else
+    {
+      Circle circle = { Dot::DOT_WIDTH / 2 + rand() % ( FIELD_WIDTH - Dot::DOT_WIDTH ), Dot::DOT_HEIGHT / 2 + rand() % ( FIELD_HEIGHT - Dot::DOT_HEIGHT ), Dot::DOT_WIDTH / 2 };
+      circles[ i ] = circle;
+      world.addBody( circles[ i ] );
+    }
+  }
+
+  //Step the field, bouncing bodies off its edges
+  std::vector<CollisionPair> contacts;
+  long long totalContacts = 0;
+  Uint64 start = SDL_GetPerformanceCounter();
+  for( int step = 0; step < STEPS; ++step )
+  {
+    for( int i = 0; i < BODY_COUNT; ++i )
+    {
+      int& x = i % 10 == 0 ? boxes[ i ].x : circles[ i ].x;
+      int& y = i % 10 == 0 ? boxes[ i ].y : circles[ i ].y;
+      int low = i % 10 == 0 ? 0 : Dot::DOT_WIDTH / 2;
+      x += velX[ i ];
+      y += velY[ i ];
+      if( x < low || x > FIELD_WIDTH - Dot::DOT_WIDTH + low )
+      {
+        velX[ i ] = -velX[ i ];
+        x += 2 * velX[ i ];
+      }
+      if( y < low || y > FIELD_HEIGHT - Dot::DOT_HEIGHT + low )
+      {
+        velY[ i ] = -velY[ i ];
+        y += 2 * velY[ i ];
+      }
+
+      if( i % 10 == 0 )
+      {
+        world.moveBody( i, boxes[ i ] );
+      }
+      else
+      {
+        world.moveBody( i, circles[ i ] );
+      }
+    }
+
+    world.findContacts( contacts );
+    totalContacts += contacts.size();
+  }
+  double sweepTime = (double)( SDL_GetPerformanceCounter() - start ) * 1000.0 / SDL_GetPerformanceFrequency() / STEPS;
+
+  //Testing every pair once for comparison
+  int bruteContacts = 0;
+  start = SDL_GetPerformanceCounter();
+  for( int a = 0; a < BODY_COUNT; ++a )
+  {
+    for( int b = a + 1; b < BODY_COUNT; ++b )
+    {
+      bool hit;
+      if( a % 10 == 0 )
+      {
+        hit = b % 10 == 0 ? checkCollision( boxes[ a ], boxes[ b ] ) : checkCollision( circles[ b ], boxes[ a ] );
+      }
+      else
+      {
+        hit = b % 10 == 0 ? checkCollision( circles[ a ], boxes[ b ] ) : checkCollision( circles[ a ], circles[ b ] );
+      }
+      bruteContacts += hit;
+    }
+  }
+  double bruteTime = (double)( SDL_GetPerformanceCounter() - start ) * 1000.0 / SDL_GetPerformanceFrequency();
+
+  printf( "%d bodies: sweep and prune %.3f ms/step (%.1f contacts), every pair %.3f ms (%d contacts, last step %d)\n", BODY_COUNT, sweepTime, (double)totalContacts / STEPS, bruteTime, bruteContacts, (int)contacts.size() );
+}
+
 int main(int argc, char *args[]) {
+  // Time the collision code without opening a window
+  if (argc > 1 && std::string(args[1]) == "--benchmark") {
+    benchmarkCollisionWorld();
+    benchmarkCollisionKernels();
+    return 0;
+  }
+
   // Start up SDL and create window
   if (!init()) {
     printf("Failed to initialize!\n");
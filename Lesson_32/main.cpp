@@ -5,6 +5,7 @@
 #include <SDL_ttf.h>
 #include <stdio.h>
 #include <string>
+#include <map>
 #include <vector>
 
 // The dimension of the level
@@ -15,6 +16,13 @@ const int LEVEL_HEIGHT = 960;
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+// Glyph atlas texture size and the gap left around each glyph
+const int GLYPH_ATLAS_SIZE = 512;
+const int GLYPH_PADDING = 1;
+
+// Gap between the input text and the sides of the screen
+const int INPUT_MARGIN = 10;
+
 // Starts up SDL and creates window
 bool init();
 
@@ -24,6 +32,9 @@ bool loadMedia();
 // Frees media and shuts down SDL
 void close();
 
+// Reads the UTF-8 character at index as UCS-2 and moves index past it
+Uint16 decodeUTF8(std::string &text, size_t &index);
+
 // Texture wrapper class
 class LTexture {
 public:
@@ -70,6 +81,149 @@ private:
   int mHeight;
 };
 
+// A glyph in the atlas
+struct LGlyph {
+  // Glyph image in the atlas, empty for glyphs that can't be drawn
+  SDL_Rect clip;
+
+  // How far the pen moves after the glyph
+  int advance;
+};
+
+// Font glyphs rasterized once into a shared texture and drawn as batched quads
+class LGlyphAtlas {
+public:
+  // Initializes variables
+  LGlyphAtlas();
+
+  // Deallocates memory
+  ~LGlyphAtlas();
+
+  // Rasterizes the printable ASCII glyphs of a font
+  bool create(TTF_Font *font);
+
+  // Deallocates texture and glyphs
+  void free();
+
+  // Gets a glyph, rasterizing it on first use
+  LGlyph &getGlyph(Uint16 ch);
+
+  // Gets the kerning between two glyphs
+  int getKerning(Uint16 previous, Uint16 ch);
+
+  // Gets the distance between lines
+  int getLineHeight();
+
+  // Gets the width of the widest line of text
+  int measureText(std::string text);
+
+  // Draws text with its top left at given point in one call
+  void renderText(int x, int y, std::string text, SDL_Color color);
+
+  // Adds a glyph quad with its top left at given point to a batch
+  void queueGlyph(LGlyph &glyph, int x, int y, SDL_Color color,
+                  std::vector<SDL_Vertex> &vertices, std::vector<int> &indices);
+
+  // Gets the glyph images
+  SDL_Texture *getTexture();
+
+private:
+  // Rasterizes a glyph into free atlas space
+  void addGlyph(Uint16 ch);
+
+  // Font the glyphs come from
+  TTF_Font *mFont;
+
+  // The glyph images
+  SDL_Texture *mTexture;
+
+  // Shelf being filled with glyphs
+  int mShelfX;
+  int mShelfY;
+  int mShelfHeight;
+
+  // Glyphs rasterized so far
+  std::map<Uint16, LGlyph> mGlyphs;
+
+  // Quads of the text being drawn
+  std::vector<SDL_Vertex> mVertices;
+  std::vector<int> mIndices;
+};
+
+// A character laid out in a text field
+struct LTextGlyph {
+  // The character and how many UTF-8 bytes it took
+  Uint16 ch;
+  int bytes;
+
+  // Where the pen put it and how far it moved after
+  int x;
+  int line;
+  int advance;
+
+  // Where its quad starts in the field's batch
+  int firstVertex;
+  int firstIndex;
+};
+
+// Editable text that keeps its layout and only lays out what changes
+class LTextField {
+public:
+  // Initializes variables
+  LTextField();
+
+  // Sets the glyphs, area, and color of the field
+  void create(LGlyphAtlas *atlas, int x, int y, int width, int height,
+              SDL_Color color);
+
+  // Replaces the text
+  void setText(std::string text);
+
+  // Adds text at the end
+  void append(std::string text);
+
+  // Removes the last character
+  void popCharacter();
+
+  // Removes all text
+  void clear();
+
+  // Gets the text
+  std::string &getText();
+
+  // Draws the lines that fit in the field, scrolled to the end
+  void render();
+
+private:
+  // Lays out one character after the last
+  void appendCharacter(Uint16 ch, int bytes);
+
+  // Gets where the next character goes
+  void getPen(int &x, int &line);
+
+  // Glyphs the field is drawn with
+  LGlyphAtlas *mAtlas;
+
+  // Field area and text color
+  int mX, mY;
+  int mWidth, mHeight;
+  SDL_Color mColor;
+
+  // The text and where each of its characters went
+  std::string mText;
+  std::vector<LTextGlyph> mGlyphs;
+
+  // Where each line starts in the batch
+  std::vector<int> mLineIndices;
+
+  // Quads of every character
+  std::vector<SDL_Vertex> mVertices;
+  std::vector<int> mIndices;
+
+  // How far the quads have been moved up to show the last line
+  int mScrollY;
+};
+
 // The application time based timer
 class LTimer {
 public:
@@ -140,9 +294,11 @@ SDL_Renderer *gRenderer = NULL;
 // Globally used font
 TTF_Font *gFont = NULL;
 
-// Scene textures
-LTexture gPromptTextTexture;
-LTexture gInputTextTexture;
+// Glyphs of the global font
+LGlyphAtlas gTextAtlas;
+
+// The text being entered
+LTextField gInputField;
 
 LTexture::LTexture() {
   // Initialize
@@ -268,6 +424,447 @@ int LTexture::getWidth() { return mWidth; }
 
 int LTexture::getHeight() { return mHeight; }
 
+LGlyphAtlas::LGlyphAtlas() {
+  // Initialize
+  mFont = NULL;
+  mTexture = NULL;
+  mShelfX = 0;
+  mShelfY = 0;
+  mShelfHeight = 0;
+}
+
+LGlyphAtlas::~LGlyphAtlas() {
+  // Deallocate
+  free();
+}
+
+bool LGlyphAtlas::create(TTF_Font *font) {
+  // Get rid of preexisting atlas
+  free();
+
+  // Create the atlas texture
+  mTexture = SDL_CreateTexture(gRenderer, SDL_PIXELFORMAT_RGBA8888,
+                               SDL_TEXTUREACCESS_STATIC, GLYPH_ATLAS_SIZE,
+                               GLYPH_ATLAS_SIZE);
+  if (mTexture == NULL) {
+    printf("Unable to create glyph atlas! SDL Error: %s\n", SDL_GetError());
+    return false;
+  }
+  SDL_SetTextureBlendMode(mTexture, SDL_BLENDMODE_BLEND);
+
+  // Clear it so filtering at glyph edges only picks up transparent pixels
+  std::vector<Uint32> blank(GLYPH_ATLAS_SIZE * GLYPH_ATLAS_SIZE, 0);
+  SDL_UpdateTexture(mTexture, NULL, &blank[0], GLYPH_ATLAS_SIZE * 4);
+
+  // Rasterize the common glyphs up front
+  mFont = font;
+  for (Uint16 ch = ' '; ch <= '~'; ++ch) {
+    addGlyph(ch);
+  }
+
+  return true;
+}
+
+void LGlyphAtlas::free() {
+  // Free texture if it exists
+  if (mTexture != NULL) {
+    SDL_DestroyTexture(mTexture);
+    mTexture = NULL;
+  }
+  mFont = NULL;
+  mShelfX = 0;
+  mShelfY = 0;
+  mShelfHeight = 0;
+  mGlyphs.clear();
+}
+
+void LGlyphAtlas::addGlyph(Uint16 ch) {
+  // Glyphs that can't be drawn still advance the pen
+  LGlyph &glyph = mGlyphs[ch];
+  glyph.clip.x = 0;
+  glyph.clip.y = 0;
+  glyph.clip.w = 0;
+  glyph.clip.h = 0;
+  glyph.advance = 0;
+
+  int minX, maxX, minY, maxY;
+  if (TTF_GlyphMetrics(mFont, ch, &minX, &maxX, &minY, &maxY,
+                       &glyph.advance) != 0) {
+    return;
+  }
+
+  // Rasterize the glyph in white so color modulation can tint it
+  SDL_Color white = {0xFF, 0xFF, 0xFF, 0xFF};
+  SDL_Surface *glyphSurface = TTF_RenderGlyph_Blended(mFont, ch, white);
+  if (glyphSurface == NULL) {
+    return;
+  }
+  SDL_Surface *formattedSurface =
+      SDL_ConvertSurfaceFormat(glyphSurface, SDL_PIXELFORMAT_RGBA8888, 0);
+  SDL_FreeSurface(glyphSurface);
+  if (formattedSurface == NULL) {
+    return;
+  }
+
+  // Start a new shelf if the glyph doesn't fit on this one
+  if (mShelfX + formattedSurface->w > GLYPH_ATLAS_SIZE) {
+    mShelfX = 0;
+    mShelfY += mShelfHeight + GLYPH_PADDING;
+    mShelfHeight = 0;
+  }
+
+  // Copy the glyph into the atlas if there's room
+  if (mShelfY + formattedSurface->h <= GLYPH_ATLAS_SIZE &&
+      formattedSurface->w <= GLYPH_ATLAS_SIZE) {
+    SDL_Rect clip = {mShelfX, mShelfY, formattedSurface->w,
+                     formattedSurface->h};
+    SDL_UpdateTexture(mTexture, &clip, formattedSurface->pixels,
+                      formattedSurface->pitch);
+    glyph.clip = clip;
+
+    mShelfX += clip.w + GLYPH_PADDING;
+    if (clip.h > mShelfHeight) {
+      mShelfHeight = clip.h;
+    }
+  } else {
+    printf("Glyph atlas is full!\n");
+  }
+
+  SDL_FreeSurface(formattedSurface);
+}
+
+LGlyph &LGlyphAtlas::getGlyph(Uint16 ch) {
+  // Rasterize glyphs on first use
+  std::map<Uint16, LGlyph>::iterator glyph = mGlyphs.find(ch);
+  if (glyph == mGlyphs.end()) {
+    addGlyph(ch);
+    glyph = mGlyphs.find(ch);
+  }
+
+  return glyph->second;
+}
+
+int LGlyphAtlas::getKerning(Uint16 previous, Uint16 ch) {
+  // Nothing to kern against at the start of a line
+  if (previous == 0) {
+    return 0;
+  }
+
+  return TTF_GetFontKerningSizeGlyphs(mFont, previous, ch);
+}
+
+int LGlyphAtlas::getLineHeight() { return TTF_FontLineSkip(mFont); }
+
+int LGlyphAtlas::measureText(std::string text) {
+  int width = 0;
+  int penX = 0;
+  Uint16 previous = 0;
+
+  // Lay out text without drawing it
+  size_t index = 0;
+  while (index < text.length()) {
+    Uint16 ch = decodeUTF8(text, index);
+    if (ch == '\n') {
+      penX = 0;
+      previous = 0;
+      continue;
+    }
+
+    penX += getKerning(previous, ch) + getGlyph(ch).advance;
+    previous = ch;
+    if (penX > width) {
+      width = penX;
+    }
+  }
+
+  return width;
+}
+
+void LGlyphAtlas::queueGlyph(LGlyph &glyph, int x, int y, SDL_Color color,
+                             std::vector<SDL_Vertex> &vertices,
+                             std::vector<int> &indices) {
+  // Texture coordinates of the glyph
+  float left = (float)glyph.clip.x / GLYPH_ATLAS_SIZE;
+  float top = (float)glyph.clip.y / GLYPH_ATLAS_SIZE;
+  float right = (float)(glyph.clip.x + glyph.clip.w) / GLYPH_ATLAS_SIZE;
+  float bottom = (float)(glyph.clip.y + glyph.clip.h) / GLYPH_ATLAS_SIZE;
+
+  // Two triangles per glyph
+  int first = vertices.size();
+  SDL_Vertex vertex;
+  vertex.color = color;
+  vertex.position.x = (float)x;
+  vertex.position.y = (float)y;
+  vertex.tex_coord.x = left;
+  vertex.tex_coord.y = top;
+  vertices.push_back(vertex);
+  vertex.position.x = (float)(x + glyph.clip.w);
+  vertex.tex_coord.x = right;
+  vertices.push_back(vertex);
+  vertex.position.y = (float)(y + glyph.clip.h);
+  vertex.tex_coord.y = bottom;
+  vertices.push_back(vertex);
+  vertex.position.x = (float)x;
+  vertex.tex_coord.x = left;
+  vertices.push_back(vertex);
+
+  indices.push_back(first);
+  indices.push_back(first + 1);
+  indices.push_back(first + 2);
+  indices.push_back(first);
+  indices.push_back(first + 2);
+  indices.push_back(first + 3);
+}
+
+SDL_Texture *LGlyphAtlas::getTexture() { return mTexture; }
+
+void LGlyphAtlas::renderText(int x, int y, std::string text,
+                             SDL_Color color) {
+  mVertices.clear();
+  mIndices.clear();
+
+  // Lay out glyphs along the pen
+  int penX = x;
+  int penY = y;
+  Uint16 previous = 0;
+  size_t index = 0;
+  while (index < text.length()) {
+    Uint16 ch = decodeUTF8(text, index);
+    if (ch == '\n') {
+      penX = x;
+      penY += getLineHeight();
+      previous = 0;
+      continue;
+    }
+
+    LGlyph &glyph = getGlyph(ch);
+    penX += getKerning(previous, ch);
+    if (glyph.clip.w > 0) {
+      queueGlyph(glyph, penX, penY, color, mVertices, mIndices);
+    }
+    penX += glyph.advance;
+    previous = ch;
+  }
+
+  // Draw all glyphs at once
+  if (!mIndices.empty()) {
+    SDL_RenderGeometry(gRenderer, mTexture, &mVertices[0], mVertices.size(),
+                       &mIndices[0], mIndices.size());
+  }
+}
+
+LTextField::LTextField() {
+  // Initialize
+  mAtlas = NULL;
+  mX = 0;
+  mY = 0;
+  mWidth = 0;
+  mHeight = 0;
+  mColor.r = 0;
+  mColor.g = 0;
+  mColor.b = 0;
+  mColor.a = 0xFF;
+  mScrollY = 0;
+  mLineIndices.push_back(0);
+}
+
+void LTextField::create(LGlyphAtlas *atlas, int x, int y, int width,
+                        int height, SDL_Color color) {
+  // Set the field up
+  mAtlas = atlas;
+  mX = x;
+  mY = y;
+  mWidth = width;
+  mHeight = height;
+  mColor = color;
+
+  // Lay the text out again in the new area
+  std::string text = mText;
+  setText(text);
+}
+
+void LTextField::setText(std::string text) {
+  clear();
+  append(text);
+}
+
+void LTextField::append(std::string text) {
+  // Nothing to lay out against yet
+  if (mAtlas == NULL) {
+    mText += text;
+    return;
+  }
+
+  // Only the new characters are laid out
+  size_t index = 0;
+  while (index < text.length()) {
+    size_t start = index;
+    Uint16 ch = decodeUTF8(text, index);
+    appendCharacter(ch, index - start);
+  }
+  mText += text;
+}
+
+void LTextField::appendCharacter(Uint16 ch, int bytes) {
+  int penX, penLine;
+  getPen(penX, penLine);
+
+  LTextGlyph placed;
+  placed.ch = ch;
+  placed.bytes = bytes;
+  placed.advance = 0;
+  placed.firstVertex = mVertices.size();
+  placed.firstIndex = mIndices.size();
+
+  // Line breaks only move the pen
+  if (ch == '\n') {
+    placed.x = penX;
+    placed.line = penLine;
+    mGlyphs.push_back(placed);
+    mLineIndices.push_back(mIndices.size());
+    return;
+  }
+
+  // Kern against the character before on the same line
+  Uint16 previous = 0;
+  if (penX > 0) {
+    previous = mGlyphs.back().ch;
+  }
+  LGlyph &glyph = mAtlas->getGlyph(ch);
+  placed.x = penX + mAtlas->getKerning(previous, ch);
+  placed.advance = glyph.advance;
+
+  // Wrap characters that run past the right edge
+  if (penX > 0 && placed.x + glyph.advance > mWidth) {
+    placed.x = 0;
+    ++penLine;
+    mLineIndices.push_back(mIndices.size());
+  }
+  placed.line = penLine;
+  mGlyphs.push_back(placed);
+
+  // Queue the quad where it shows with the current scrolling
+  if (glyph.clip.w > 0) {
+    mAtlas->queueGlyph(glyph, mX + placed.x,
+                       mY + placed.line * mAtlas->getLineHeight() - mScrollY,
+                       mColor, mVertices, mIndices);
+  }
+}
+
+void LTextField::getPen(int &x, int &line) {
+  // Start of the field
+  x = 0;
+  line = 0;
+
+  // After the last character
+  if (!mGlyphs.empty()) {
+    LTextGlyph &last = mGlyphs.back();
+    if (last.ch == '\n') {
+      line = last.line + 1;
+    } else {
+      x = last.x + last.advance;
+      line = last.line;
+    }
+  }
+}
+
+void LTextField::popCharacter() {
+  if (mGlyphs.empty()) {
+    return;
+  }
+
+  // Drop the character's bytes and quad
+  LTextGlyph &last = mGlyphs.back();
+  mText.resize(mText.length() - last.bytes);
+  mVertices.resize(last.firstVertex);
+  mIndices.resize(last.firstIndex);
+  mGlyphs.pop_back();
+
+  // Drop the line it started, if any
+  int penX, penLine;
+  getPen(penX, penLine);
+  mLineIndices.resize(penLine + 1);
+}
+
+void LTextField::clear() {
+  // Keep the storage for new text
+  mText.clear();
+  mGlyphs.clear();
+  mVertices.clear();
+  mIndices.clear();
+  mLineIndices.clear();
+  mLineIndices.push_back(0);
+  mScrollY = 0;
+}
+
+std::string &LTextField::getText() { return mText; }
+
+void LTextField::render() {
+  if (mAtlas == NULL) {
+    return;
+  }
+
+  // Show as many of the last lines as fit
+  int lineHeight = mAtlas->getLineHeight();
+  int visibleLines = mHeight / lineHeight;
+  if (visibleLines < 1) {
+    visibleLines = 1;
+  }
+  int firstLine = (int)mLineIndices.size() - visibleLines;
+  if (firstLine < 0) {
+    firstLine = 0;
+  }
+
+  // Move the quads only when the scrolling changes
+  int scrollY = firstLine * lineHeight;
+  if (scrollY != mScrollY) {
+    float offset = (float)(mScrollY - scrollY);
+    for (size_t i = 0; i < mVertices.size(); ++i) {
+      mVertices[i].position.y += offset;
+    }
+    mScrollY = scrollY;
+  }
+
+  // Draw the visible lines at once
+  int firstIndex = mLineIndices[firstLine];
+  if (firstIndex < (int)mIndices.size()) {
+    SDL_RenderGeometry(gRenderer, mAtlas->getTexture(), &mVertices[0],
+                       mVertices.size(), &mIndices[firstIndex],
+                       mIndices.size() - firstIndex);
+  }
+}
+
+Uint16 decodeUTF8(std::string &text, size_t &index) {
+  // Number of continuation bytes and the bits the lead byte holds
+  Uint8 lead = text[index++];
+  int continuation = 0;
+  Uint32 ch = lead;
+  if (lead >= 0xF0) {
+    continuation = 3;
+    ch = lead & 0x07;
+  } else if (lead >= 0xE0) {
+    continuation = 2;
+    ch = lead & 0x0F;
+  } else if (lead >= 0xC0) {
+    continuation = 1;
+    ch = lead & 0x1F;
+  } else if (lead >= 0x80) {
+    // Stray continuation byte
+    return '?';
+  }
+
+  // Add the continuation bits
+  for (int i = 0; i < continuation; ++i) {
+    if (index >= text.length() || (text[index] & 0xC0) != 0x80) {
+      return '?';
+    }
+    ch = (ch << 6) | (text[index++] & 0x3F);
+  }
+
+  // Fonts are looked up by UCS-2
+  return ch > 0xFFFF ? '?' : (Uint16)ch;
+}
+
 bool init() {
   // Initialization flag
   bool success = true;
@@ -331,11 +928,17 @@ bool loadMedia() {
     printf("Failed to load lazy font! SDL_ttf Error: %s\n", TTF_GetError());
     success = false;
   } else {
-    // Render the prompt
-    SDL_Color textColor = {0, 0, 0, 0xFF};
-    if (!gPromptTextTexture.loadFromRenderedText("Enter Text:", textColor)) {
-      printf("Failed to render prompt text!\n");
+    // Rasterize the font's glyphs
+    if (!gTextAtlas.create(gFont)) {
+      printf("Failed to create glyph atlas!\n");
       success = false;
+    } else {
+      // Put the input below the prompt
+      SDL_Color textColor = {0, 0, 0, 0xFF};
+      int lineHeight = gTextAtlas.getLineHeight();
+      gInputField.create(&gTextAtlas, INPUT_MARGIN, lineHeight,
+                         SCREEN_WIDTH - INPUT_MARGIN * 2,
+                         SCREEN_HEIGHT - lineHeight, textColor);
     }
   }
 
@@ -343,6 +946,8 @@ bool loadMedia() {
 }
 
 void close() {
+  // Free glyph atlas
+  gTextAtlas.free();
 
   // Destroy window
   SDL_DestroyRenderer(gRenderer);
@@ -375,17 +980,16 @@ int main(int argc, char *args[]) {
       SDL_Color textColor = {0, 0, 0, 0xFF};
 
       // The current input text.
-      std::string inputText = "Some Text";
-      gInputTextTexture.loadFromRenderedText(inputText.c_str(), textColor);
+      gInputField.setText("Some Text");
+
+      // The prompt above it
+      std::string promptText = "Enter Text:";
 
       // Enable text input
       SDL_StartTextInput();
 
       // While application is running
       while (!quit) {
-        // The rerender text flag
-        bool renderText = false;
-
         // Handle events on queue
         while (SDL_PollEvent(&e) != 0) {
           // User requests quit
@@ -395,21 +999,21 @@ int main(int argc, char *args[]) {
           // Special key input
           else if (e.type == SDL_KEYDOWN) {
             // Handle backspace
-            if (e.key.keysym.sym == SDLK_BACKSPACE && inputText.length() > 0) {
+            if (e.key.keysym.sym == SDLK_BACKSPACE) {
               // lop off character
-              inputText.pop_back();
-              renderText = true;
+              gInputField.popCharacter();
             }
             // Handle copy
             else if (e.key.keysym.sym == SDLK_c &&
                      SDL_GetModState() & KMOD_CTRL) {
-              SDL_SetClipboardText(inputText.c_str());
+              SDL_SetClipboardText(gInputField.getText().c_str());
             }
             // Handle paster
             else if (e.key.keysym.sym == SDLK_v &&
                      SDL_GetModState() & KMOD_CTRL) {
-              inputText = SDL_GetClipboardText();
-              renderText = true;
+              char *clipboardText = SDL_GetClipboardText();
+              gInputField.setText(clipboardText);
+              SDL_free(clipboardText);
             }
           }
           // Special text input event
@@ -419,33 +1023,19 @@ int main(int argc, char *args[]) {
                   (e.text.text[0] == 'c' || e.text.text[0] == 'C' ||
                    e.text.text[0] == 'v' || e.text.text[0] == 'V'))) {
               // Append character
-              inputText += e.text.text;
-              renderText = true;
+              gInputField.append(e.text.text);
             }
           }
         }
-        // Rerender text if needed
-        if (renderText) {
-          // Text is not empty
-          if (inputText != "") {
-            // Render new text
-            gInputTextTexture.loadFromRenderedText(inputText.c_str(),
-                                                   textColor);
-          } else {
-            // Render space texture
-            gInputTextTexture.loadFromRenderedText(" ", textColor);
-          }
-        }
         // Clear screen
         SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
         SDL_RenderClear(gRenderer);
 
-        // Render text textures
-        gPromptTextTexture.render(
-            (SCREEN_WIDTH - gPromptTextTexture.getWidth()) / 2, 0);
-        gInputTextTexture.render((SCREEN_WIDTH - gInputTextTexture.getWidth()) /
-                                     2,
-                                 gPromptTextTexture.getHeight());
+        // Render text from the glyph atlas
+        gTextAtlas.renderText(
+            (SCREEN_WIDTH - gTextAtlas.measureText(promptText)) / 2, 0,
+            promptText, textColor);
+        gInputField.render();
 
         // Update screen
         SDL_RenderPresent(gRenderer);
@@ -1,11 +1,28 @@
 /*This source code copyrighted by Lazy Foo' Productions (2004-2022)
 and may not be redistributed without written permission.*/
 
-//Using SDL, SDL_image, standard IO, and strings
+//Using SDL, SDL_image, SDL_thread, standard IO, strings, maps, vectors, and sorting
 #include <SDL.h>
 #include <SDL_image.h>
+#include <SDL_thread.h>
 #include <stdio.h>
 #include <string>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+//Using SSE2 and AVX2 intrinsics on x86
+#if defined( __x86_64__ ) || defined( _M_X64 ) || defined( __i386__ ) || defined( _M_IX86 )
+#define PARTICLE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+//Lets GCC and Clang compile a function for an instruction set the rest of the program doesn't assume
+#if defined( __GNUC__ ) || defined( __clang__ )
+#define TARGET_ISA( isa ) __attribute__(( target( isa ) ))
+#else
+#define TARGET_ISA( isa )
+#endif
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 640;
@@ -14,6 +31,72 @@ const int SCREEN_HEIGHT = 480;
 //Particle count
 const int TOTAL_PARTICLES = 20;
 
+//Number of colored particle types
+const int TOTAL_PARTICLE_TYPES = 3;
+
+//Frame after which a particle dies
+const int PARTICLE_LIFETIME = 10;
+
+//Particles simulated together by one worker job
+const int PARTICLE_CHUNK_SIZE = 16384;
+
+//Empty pixels between packed atlas images so linear filtering doesn't bleed
+const int ATLAS_PADDING = 1;
+
+//Hardware texture shared between every LTexture loaded from the same path
+struct LCachedTexture
+{
+	//The actual hardware texture
+	SDL_Texture* texture;
+
+	//Image dimensions
+	int width;
+	int height;
+
+	//Number of LTextures using this texture
+	int refCount;
+
+	//Modulation last applied to the texture by any of them
+	Uint8 red, green, blue, alpha;
+	SDL_BlendMode blendMode;
+
+	//Packed regions by image path when the texture is an atlas
+	std::map<std::string, SDL_Rect> clips;
+};
+
+//Reference counted texture cache keyed by image path
+class LTextureCache
+{
+	public:
+		//Initializes variables
+		LTextureCache();
+
+		//Deallocates remaining textures
+		~LTextureCache();
+
+		//Gets the texture for the path, loading it on first request
+		LCachedTexture* acquire( std::string path );
+
+		//Gets a texture already cached under key, NULL if there isn't one
+		LCachedTexture* find( std::string key );
+
+		//Creates a texture from surface pixels and caches it under key
+		LCachedTexture* add( std::string key, SDL_Surface* surface );
+
+		//Drops a reference and destroys the texture once it is unused
+		void release( LCachedTexture* entry );
+
+		//Destroys every cached texture
+		void clear();
+
+		//Gets number of cached textures
+		int getSize();
+
+	private:
+		//Loaded textures by path
+		std::map<std::string, LCachedTexture*> mTextures;
+};
+
 //Texture wrapper class
 class LTexture
 {
@@ -26,6 +109,9 @@ class LTexture
 
 		//Loads image at specified path
 		bool loadFromFile( std::string path );
+
+		//Shares a texture owned by the cache, taking over the reference
+		bool loadFromCache( LCachedTexture* entry );
 		
 		#if defined(SDL_TTF_MAJOR_VERSION)
 		//Creates image from font string
@@ -55,34 +141,192 @@ class LTexture
 		//The actual hardware texture
 		SDL_Texture* mTexture;
 
+		//Cache entry when the texture was loaded from file
+		LCachedTexture* mCached;
+
+		//Modulation applied before rendering shared textures
+		Uint8 mRed, mGreen, mBlue, mAlpha;
+		SDL_BlendMode mBlendMode;
+
 		//Image dimensions
 		int mWidth;
 		int mHeight;
 };
 
-class Particle
+//Several images packed into one texture
+class LTextureAtlas
 {
 	public:
-		//Initialize position and animation
-		Particle( int x, int y );
+		//Initializes variables
+		LTextureAtlas();
 
-		//Shows the particle
-		void render();
+		//Deallocates memory
+		~LTextureAtlas();
+
+		//Packs images at specified paths into a texture no wider than maxWidth
+		bool loadFromFiles( std::vector<std::string> paths, int maxWidth = 1024 );
+
+		//Deallocates atlas
+		void free();
+
+		//Gets the region an image was packed into
+		SDL_Rect* getClip( std::string path );
 
-		//Checks if particle is dead
-		bool isDead();
+		//Gets the packed texture
+		LTexture* getTexture();
+
+	private:
+		//The packed texture
+		LTexture mTexture;
+
+		//Packed regions by image path
+		std::map<std::string, SDL_Rect> mClips;
+};
+
+//Advances count particle frames and returns how many are now past lifetime
+typedef int ( *ParticleAgeKernel )( int* frames, int count, int lifetime );
+
+//Portable particle aging
+int ageParticlesScalar( int* frames, int count, int lifetime );
+
+#if defined( PARTICLE_SIMD_X86 )
+//Particle aging 8 frames at a time
+int ageParticlesSSE2( int* frames, int count, int lifetime );
+int ageParticlesAVX2( int* frames, int count, int lifetime );
+#endif
+
+//Gets the fastest particle aging kernel this CPU supports
+ParticleAgeKernel getParticleAgeKernel();
+
+//Times the particle aging kernels at several particle counts
+void benchmarkParticles();
+
+//Copy of particle state the main thread draws while workers simulate the next step
+struct ParticleSnapshot
+{
+	//Offsets
+	std::vector<int> posX, posY;
+
+	//Current frame of animation
+	std::vector<int> frame;
+
+	//Type of particle
+	std::vector<Uint8> type;
+
+	//Particles in the snapshot
+	int count;
+};
+
+//Particles stored as parallel arrays so updates walk contiguous memory
+class ParticleEmitter
+{
+	public:
+		//Allocates storage for the maximum number of live particles
+		ParticleEmitter( int capacity, Uint32 seed = 0x9E3779B9 );
+
+		//Spawns up to count particles around given point
+		void emit( int x, int y, int count );
+
+		//Animates particles and removes dead ones
+		void update();
+
+		//Copies live particles for rendering
+		void copyTo( ParticleSnapshot& snapshot );
+
+		//Sets the kernel that ages particles
+		void setAgeKernel( ParticleAgeKernel kernel );
+
+		//Gets particle counts
+		int getCount();
+		int getCapacity();
 
 	private:
 		//Offsets
-		int mPosX, mPosY;
+		std::vector<int> mPosX, mPosY;
 
 		//Current frame of animation
-		int mFrame;
+		std::vector<int> mFrame;
 
 		//Type of particle
-		LTexture *mTexture;
+		std::vector<Uint8> mType;
+
+		//Live particles at the front of the arrays
+		int mCount;
+
+		//Ages particles
+		ParticleAgeKernel mAgeKernel;
+
+		//Random number generator state
+		Uint32 mRandom;
+
+		//Gets random number in [0, range)
+		int random( int range );
 };
 
+//Particles split into chunks that a pool of worker threads simulates
+class ParticleSimulation
+{
+	public:
+		//Splits capacity particles into chunks and starts workerCount threads
+		ParticleSimulation( int capacity, int workerCount );
+
+		//Stops the worker threads
+		~ParticleSimulation();
+
+		//Starts the workers on one step spawning around given point
+		void start( int x, int y );
+
+		//Waits for the running step and makes its particles the ones to render
+		void finish();
+
+		//Shows the particles of the last finished step
+		void render();
+
+		//Gets the number of worker threads, 0 when steps run on the calling thread
+		int getWorkerCount();
+
+	private:
+		//Worker thread entry point
+		static int worker( void* data );
+
+		//Claims and simulates chunks until none are left
+		int simulateChunks();
+
+		//Independent groups of particles
+		std::vector<ParticleEmitter> mChunks;
+
+		//Snapshots being drawn and being written
+		std::vector<ParticleSnapshot> mFront;
+		std::vector<ParticleSnapshot> mBack;
+
+		//Worker threads
+		std::vector<SDL_Thread*> mWorkers;
+
+		//Protects the step state
+		SDL_mutex* mLock;
+
+		//Signals workers that a step started and the main thread that it finished
+		SDL_cond* mCanWork;
+		SDL_cond* mDone;
+
+		//Number of the latest step
+		int mStep;
+
+		//Whether a step was started and not yet finished
+		bool mRunning;
+
+		//Workers still inside a step
+		int mBusyWorkers;
+
+		//Next unclaimed chunk
+		SDL_atomic_t mNextChunk;
+
+		//Where the current step spawns particles
+		int mSpawnX, mSpawnY;
+
+		//Whether the workers should exit
+		bool mQuit;
+};
 
 //The dot that will move around on the screen
 class Dot
@@ -98,9 +342,6 @@ class Dot
 		//Initializes the variables and allocates particles
 		Dot();
 
-		//Deallocates particles
-		~Dot();
-
 		//Takes key presses and adjusts the dot's velocity
 		void handleEvent( SDL_Event& e );
 
@@ -112,7 +353,7 @@ class Dot
 
     private:
 		//The particles
-		Particle* particles[ TOTAL_PARTICLES ];
+		ParticleSimulation mParticles;
 
 		//Shows the particles
 		void renderParticles();
@@ -139,65 +380,177 @@ SDL_Window* gWindow = NULL;
 //The window renderer
 SDL_Renderer* gRenderer = NULL;
 
+//Textures loaded from file
+LTextureCache gTextureCache;
+
 //Scene textures
 LTexture gDotTexture;
-LTexture gRedTexture;
-LTexture gGreenTexture;
-LTexture gBlueTexture;
-LTexture gShimmerTexture;
+LTextureAtlas gParticleAtlas;
 
-LTexture::LTexture()
+//Particle regions in the atlas
+SDL_Rect* gParticleClips[ TOTAL_PARTICLE_TYPES ] = { NULL, NULL, NULL };
+SDL_Rect* gShimmerClip = NULL;
+
+LTextureCache::LTextureCache()
 {
-	//Initialize
-	mTexture = NULL;
-	mWidth = 0;
-	mHeight = 0;
 }
 
-LTexture::~LTexture()
+LTextureCache::~LTextureCache()
 {
 	//Deallocate
-	free();
+	clear();
 }
 
-bool LTexture::loadFromFile( std::string path )
+LCachedTexture* LTextureCache::acquire( std::string path )
 {
-	//Get rid of preexisting texture
-	free();
-
-	//The final texture
-	SDL_Texture* newTexture = NULL;
+	//Reuse texture if it was already loaded
+	LCachedTexture* entry = find( path );
+	if( entry != NULL )
+	{
+		return entry;
+	}
 
 	//Load image at specified path
 	SDL_Surface* loadedSurface = IMG_Load( path.c_str() );
 	if( loadedSurface == NULL )
 	{
 		printf( "Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError() );
+		return NULL;
 	}
-	else
+
+	//Color key image
+	SDL_SetColorKey( loadedSurface, SDL_TRUE, SDL_MapRGB( loadedSurface->format, 0, 0xFF, 0xFF ) );
+
+	//Create and store texture
+	entry = add( path, loadedSurface );
+	if( entry == NULL )
 	{
-		//Color key image
-		SDL_SetColorKey( loadedSurface, SDL_TRUE, SDL_MapRGB( loadedSurface->format, 0, 0xFF, 0xFF ) );
+		printf( "Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError() );
+	}
 
-		//Create texture from surface pixels
-        newTexture = SDL_CreateTextureFromSurface( gRenderer, loadedSurface );
-		if( newTexture == NULL )
-		{
-			printf( "Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError() );
-		}
-		else
+	//Get rid of old loaded surface
+	SDL_FreeSurface( loadedSurface );
+
+	return entry;
+}
+
+LCachedTexture* LTextureCache::find( std::string key )
+{
+	//Take another reference to a cached texture
+	std::map<std::string, LCachedTexture*>::iterator it = mTextures.find( key );
+	if( it == mTextures.end() )
+	{
+		return NULL;
+	}
+
+	it->second->refCount++;
+	return it->second;
+}
+
+LCachedTexture* LTextureCache::add( std::string key, SDL_Surface* surface )
+{
+	//Create texture from surface pixels
+	SDL_Texture* newTexture = SDL_CreateTextureFromSurface( gRenderer, surface );
+	if( newTexture == NULL )
+	{
+		return NULL;
+	}
+
+	//Store the new texture
+	LCachedTexture* entry = new LCachedTexture;
+	entry->texture = newTexture;
+	entry->width = surface->w;
+	entry->height = surface->h;
+	entry->refCount = 1;
+	entry->red = 0xFF;
+	entry->green = 0xFF;
+	entry->blue = 0xFF;
+	entry->alpha = 0xFF;
+	SDL_GetTextureBlendMode( newTexture, &entry->blendMode );
+	mTextures[ key ] = entry;
+
+	return entry;
+}
+
+void LTextureCache::release( LCachedTexture* entry )
+{
+	//Keep texture while it is still in use
+	if( entry == NULL || --entry->refCount > 0 )
+	{
+		return;
+	}
+
+	//Remove unused texture
+	for( std::map<std::string, LCachedTexture*>::iterator it = mTextures.begin(); it != mTextures.end(); ++it )
+	{
+		if( it->second == entry )
 		{
-			//Get image dimensions
-			mWidth = loadedSurface->w;
-			mHeight = loadedSurface->h;
+			mTextures.erase( it );
+			break;
 		}
+	}
+
+	SDL_DestroyTexture( entry->texture );
+	delete entry;
+}
+
+void LTextureCache::clear()
+{
+	//Destroy all textures
+	for( std::map<std::string, LCachedTexture*>::iterator it = mTextures.begin(); it != mTextures.end(); ++it )
+	{
+		SDL_DestroyTexture( it->second->texture );
+		delete it->second;
+	}
+	mTextures.clear();
+}
+
+int LTextureCache::getSize()
+{
+	return mTextures.size();
+}
+
+LTexture::LTexture()
+{
+	//Initialize
+	mTexture = NULL;
+	mCached = NULL;
+	mRed = 0xFF;
+	mGreen = 0xFF;
+	mBlue = 0xFF;
+	mAlpha = 0xFF;
+	mBlendMode = SDL_BLENDMODE_BLEND;
+	mWidth = 0;
+	mHeight = 0;
+}
+
+LTexture::~LTexture()
+{
+	//Deallocate
+	free();
+}
+
+bool LTexture::loadFromFile( std::string path )
+{
+	//Get shared texture, decoding the image only on first use
+	return loadFromCache( gTextureCache.acquire( path ) );
+}
 
-		//Get rid of old loaded surface
-		SDL_FreeSurface( loadedSurface );
+bool LTexture::loadFromCache( LCachedTexture* entry )
+{
+	//Get rid of preexisting texture
+	free();
+
+	//Use the shared texture
+	mCached = entry;
+	if( mCached != NULL )
+	{
+		mTexture = mCached->texture;
+		mWidth = mCached->width;
+		mHeight = mCached->height;
 	}
 
 	//Return success
-	mTexture = newTexture;
 	return mTexture != NULL;
 }
 
@@ -243,7 +596,16 @@ void LTexture::free()
 	//Free texture if it exists
 	if( mTexture != NULL )
 	{
-		SDL_DestroyTexture( mTexture );
+		//Shared textures are owned by the cache
+		if( mCached != NULL )
+		{
+			gTextureCache.release( mCached );
+			mCached = NULL;
+		}
+		else
+		{
+			SDL_DestroyTexture( mTexture );
+		}
 		mTexture = NULL;
 		mWidth = 0;
 		mHeight = 0;
@@ -253,19 +615,38 @@ void LTexture::free()
 void LTexture::setColor( Uint8 red, Uint8 green, Uint8 blue )
 {
 	//Modulate texture rgb
+	mRed = red;
+	mGreen = green;
+	mBlue = blue;
 	SDL_SetTextureColorMod( mTexture, red, green, blue );
+	if( mCached != NULL )
+	{
+		mCached->red = red;
+		mCached->green = green;
+		mCached->blue = blue;
+	}
 }
 
 void LTexture::setBlendMode( SDL_BlendMode blending )
 {
 	//Set blending function
+	mBlendMode = blending;
 	SDL_SetTextureBlendMode( mTexture, blending );
+	if( mCached != NULL )
+	{
+		mCached->blendMode = blending;
+	}
 }
 		
 void LTexture::setAlpha( Uint8 alpha )
 {
 	//Modulate texture alpha
+	mAlpha = alpha;
 	SDL_SetTextureAlphaMod( mTexture, alpha );
+	if( mCached != NULL )
+	{
+		mCached->alpha = alpha;
+	}
 }
 
 void LTexture::render( int x, int y, SDL_Rect* clip, double angle, SDL_Point* center, SDL_RendererFlip flip )
@@ -280,6 +661,28 @@ void LTexture::render( int x, int y, SDL_Rect* clip, double angle, SDL_Point* ce
 		renderQuad.h = clip->h;
 	}
 
+	//Other users of a shared texture may have changed its modulation, even ones that have since been freed
+	if( mCached != NULL )
+	{
+		if( mCached->red != mRed || mCached->green != mGreen || mCached->blue != mBlue )
+		{
+			SDL_SetTextureColorMod( mTexture, mRed, mGreen, mBlue );
+			mCached->red = mRed;
+			mCached->green = mGreen;
+			mCached->blue = mBlue;
+		}
+		if( mCached->alpha != mAlpha )
+		{
+			SDL_SetTextureAlphaMod( mTexture, mAlpha );
+			mCached->alpha = mAlpha;
+		}
+		if( mCached->blendMode != mBlendMode )
+		{
+			SDL_SetTextureBlendMode( mTexture, mBlendMode );
+			mCached->blendMode = mBlendMode;
+		}
+	}
+
 	//Render to screen
 	SDL_RenderCopyEx( gRenderer, mTexture, clip, &renderQuad, angle, center, flip );
 }
@@ -294,45 +697,646 @@ int LTexture::getHeight()
 	return mHeight;
 }
 
-Particle::Particle( int x, int y )
+LTextureAtlas::LTextureAtlas()
+{
+}
+
+LTextureAtlas::~LTextureAtlas()
+{
+	//Deallocate
+	free();
+}
+
+bool LTextureAtlas::loadFromFiles( std::vector<std::string> paths, int maxWidth )
 {
-    //Set offsets
-    mPosX = x - 5 + ( rand() % 25 );
-    mPosY = y - 5 + ( rand() % 25 );
+	//Get rid of preexisting atlas
+	free();
 
-    //Initialize animation
-    mFrame = rand() % 5;
+	//The same images packed the same way share one cache entry
+	std::string key = "atlas " + std::to_string( maxWidth );
+	for( size_t i = 0; i < paths.size(); ++i )
+	{
+		key += "\n" + paths[ i ];
+	}
+	LCachedTexture* cached = gTextureCache.find( key );
+	if( cached != NULL )
+	{
+		mClips = cached->clips;
+		return mTexture.loadFromCache( cached );
+	}
 
-    //Set type
-    switch( rand() % 3 )
-    {
-        case 0: mTexture = &gRedTexture; break;
-        case 1: mTexture = &gGreenTexture; break;
-        case 2: mTexture = &gBlueTexture; break;
-    }
+	//Loading success flag
+	bool success = true;
+
+	//Load every image
+	std::vector<SDL_Surface*> surfaces( paths.size(), (SDL_Surface*)NULL );
+	for( size_t i = 0; i < paths.size(); ++i )
+	{
+		surfaces[ i ] = IMG_Load( paths[ i ].c_str() );
+		if( surfaces[ i ] == NULL )
+		{
+			printf( "Unable to load image %s! SDL_image Error: %s\n", paths[ i ].c_str(), IMG_GetError() );
+			success = false;
+		}
+		else
+		{
+			//Color key image and copy its pixels as they are
+			SDL_SetColorKey( surfaces[ i ], SDL_TRUE, SDL_MapRGB( surfaces[ i ]->format, 0, 0xFF, 0xFF ) );
+			SDL_SetSurfaceBlendMode( surfaces[ i ], SDL_BLENDMODE_NONE );
+		}
+	}
+
+	if( success )
+	{
+		//Pack tallest images first so each shelf wastes little height
+		std::vector<size_t> order( paths.size() );
+		for( size_t i = 0; i < order.size(); ++i )
+		{
+			order[ i ] = i;
+		}
+		std::sort( order.begin(), order.end(), [ &surfaces ]( size_t a, size_t b ) { return surfaces[ a ]->h > surfaces[ b ]->h; } );
+
+		//Place images left to right on shelves, starting a new shelf when a row fills up
+		int shelfX = 0;
+		int shelfY = 0;
+		int shelfHeight = 0;
+		int atlasWidth = 0;
+		for( size_t i = 0; i < order.size() && success; ++i )
+		{
+			SDL_Surface* surface = surfaces[ order[ i ] ];
+
+			//Skip images requested more than once
+			if( mClips.find( paths[ order[ i ] ] ) != mClips.end() )
+			{
+				continue;
+			}
+
+			if( surface->w > maxWidth )
+			{
+				printf( "Image %s is wider than the atlas!\n", paths[ order[ i ] ].c_str() );
+				success = false;
+			}
+			else
+			{
+				//Go to the next shelf
+				if( shelfX + surface->w > maxWidth )
+				{
+					shelfX = 0;
+					shelfY += shelfHeight + ATLAS_PADDING;
+					shelfHeight = 0;
+				}
+
+				//Set the image region
+				SDL_Rect clip = { shelfX, shelfY, surface->w, surface->h };
+				mClips[ paths[ order[ i ] ] ] = clip;
+
+				//Move along the shelf
+				shelfX += surface->w + ATLAS_PADDING;
+				shelfHeight = std::max( shelfHeight, surface->h );
+				atlasWidth = std::max( atlasWidth, shelfX );
+			}
+		}
+
+		if( success )
+		{
+			//Copy images into one transparent surface
+			SDL_Surface* atlasSurface = SDL_CreateRGBSurfaceWithFormat( 0, atlasWidth, shelfY + shelfHeight, 32, SDL_PIXELFORMAT_RGBA8888 );
+			if( atlasSurface == NULL )
+			{
+				printf( "Unable to create atlas surface! SDL Error: %s\n", SDL_GetError() );
+				success = false;
+			}
+			else
+			{
+				for( size_t i = 0; i < paths.size(); ++i )
+				{
+					SDL_Rect destination = mClips[ paths[ i ] ];
+					SDL_BlitSurface( surfaces[ i ], NULL, atlasSurface, &destination );
+				}
+
+				//Upload the packed images once and keep them for later loads of the same atlas
+				cached = gTextureCache.add( key, atlasSurface );
+				if( cached == NULL )
+				{
+					printf( "Unable to create atlas texture! SDL Error: %s\n", SDL_GetError() );
+				}
+				else
+				{
+					cached->clips = mClips;
+				}
+				success = mTexture.loadFromCache( cached );
+				SDL_FreeSurface( atlasSurface );
+			}
+		}
+	}
+
+	//Get rid of loaded surfaces
+	for( size_t i = 0; i < surfaces.size(); ++i )
+	{
+		if( surfaces[ i ] != NULL )
+		{
+			SDL_FreeSurface( surfaces[ i ] );
+		}
+	}
+
+	if( !success )
+	{
+		free();
+	}
+
+	return success;
 }
 
-void Particle::render()
+void LTextureAtlas::free()
 {
-    //Show image
-	mTexture->render( mPosX, mPosY );
+	//Deallocate texture and regions
+	mTexture.free();
+	mClips.clear();
+}
 
-    //Show shimmer
-    if( mFrame % 2 == 0 )
-    {
-		gShimmerTexture.render( mPosX, mPosY );
-    }
+SDL_Rect* LTextureAtlas::getClip( std::string path )
+{
+	//Find packed region
+	std::map<std::string, SDL_Rect>::iterator it = mClips.find( path );
+	if( it == mClips.end() )
+	{
+		return NULL;
+	}
 
-    //Animate
-    mFrame++;
+	return &it->second;
 }
 
-bool Particle::isDead()
+LTexture* LTextureAtlas::getTexture()
 {
-    return mFrame > 10;
+	return &mTexture;
 }
 
-Dot::Dot()
+int ageParticlesScalar( int* frames, int count, int lifetime )
+{
+	int dead = 0;
+	for( int i = 0; i < count; ++i )
+	{
+		//Animate
+		frames[ i ]++;
+
+		//Count dead particles
+		if( frames[ i ] > lifetime )
+		{
+			dead++;
+		}
+	}
+
+	return dead;
+}
+
+#if defined( PARTICLE_SIMD_X86 )
+TARGET_ISA( "sse2" ) int ageParticlesSSE2( int* frames, int count, int lifetime )
+{
+	__m128i one = _mm_set1_epi32( 1 );
+	__m128i limit = _mm_set1_epi32( lifetime );
+	__m128i deadLanes = _mm_setzero_si128();
+
+	int i = 0;
+	for( ; i + 8 <= count; i += 8 )
+	{
+		//Animate two groups of four
+		__m128i low = _mm_add_epi32( _mm_loadu_si128( (__m128i*)( frames + i ) ), one );
+		__m128i high = _mm_add_epi32( _mm_loadu_si128( (__m128i*)( frames + i + 4 ) ), one );
+		_mm_storeu_si128( (__m128i*)( frames + i ), low );
+		_mm_storeu_si128( (__m128i*)( frames + i + 4 ), high );
+
+		//Dead lanes compare to -1, so subtracting counts them
+		deadLanes = _mm_sub_epi32( deadLanes, _mm_cmpgt_epi32( low, limit ) );
+		deadLanes = _mm_sub_epi32( deadLanes, _mm_cmpgt_epi32( high, limit ) );
+	}
+
+	//Add up the lanes
+	int lanes[ 4 ];
+	_mm_storeu_si128( (__m128i*)lanes, deadLanes );
+	int dead = lanes[ 0 ] + lanes[ 1 ] + lanes[ 2 ] + lanes[ 3 ];
+
+	//Finish the tail
+	return dead + ageParticlesScalar( frames + i, count - i, lifetime );
+}
+
+TARGET_ISA( "avx2" ) int ageParticlesAVX2( int* frames, int count, int lifetime )
+{
+	__m256i one = _mm256_set1_epi32( 1 );
+	__m256i limit = _mm256_set1_epi32( lifetime );
+	__m256i deadLanes = _mm256_setzero_si256();
+
+	int i = 0;
+	for( ; i + 8 <= count; i += 8 )
+	{
+		//Animate eight at once
+		__m256i frame = _mm256_add_epi32( _mm256_loadu_si256( (__m256i*)( frames + i ) ), one );
+		_mm256_storeu_si256( (__m256i*)( frames + i ), frame );
+
+		//Dead lanes compare to -1, so subtracting counts them
+		deadLanes = _mm256_sub_epi32( deadLanes, _mm256_cmpgt_epi32( frame, limit ) );
+	}
+
+	//Add up the lanes
+	int lanes[ 8 ];
+	_mm256_storeu_si256( (__m256i*)lanes, deadLanes );
+	int dead = 0;
+	for( int lane = 0; lane < 8; ++lane )
+	{
+		dead += lanes[ lane ];
+	}
+
+	//Finish the tail
+	return dead + ageParticlesScalar( frames + i, count - i, lifetime );
+}
+#endif
+
+ParticleAgeKernel getParticleAgeKernel()
+{
+	#if defined( PARTICLE_SIMD_X86 )
+	if( SDL_HasAVX2() )
+	{
+		return ageParticlesAVX2;
+	}
+	if( SDL_HasSSE2() )
+	{
+		return ageParticlesSSE2;
+	}
+	#endif
+
+	return ageParticlesScalar;
+}
+
+void benchmarkParticles()
+{
+	//Kernels to compare
+	std::vector<ParticleAgeKernel> kernels;
+	std::vector<std::string> names;
+	kernels.push_back( ageParticlesScalar );
+	names.push_back( "scalar" );
+	#if defined( PARTICLE_SIMD_X86 )
+	if( SDL_HasSSE2() )
+	{
+		kernels.push_back( ageParticlesSSE2 );
+		names.push_back( "SSE2" );
+	}
+	if( SDL_HasAVX2() )
+	{
+		kernels.push_back( ageParticlesAVX2 );
+		names.push_back( "AVX2" );
+	}
+	#endif
+
+	//Particle counts to test
+	const int counts[] = { 10000, 100000, 1000000 };
+
+	printf( "%10s %10s %16s\n", "particles", "kernel", "ns per particle" );
+	for( int c = 0; c < 3; ++c )
+	{
+		//Run about the same number of particle updates at every count
+		int iterations = std::max( 20, 100000000 / counts[ c ] );
+
+		for( size_t k = 0; k < kernels.size(); ++k )
+		{
+			//Same starting particles for every kernel
+			ParticleEmitter emitter( counts[ c ] );
+			emitter.setAgeKernel( kernels[ k ] );
+			emitter.emit( SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2, counts[ c ] );
+
+			//Time only the updates, refilling dead particles in between
+			Uint64 ticks = 0;
+			for( int i = 0; i < iterations; ++i )
+			{
+				Uint64 start = SDL_GetPerformanceCounter();
+				emitter.update();
+				ticks += SDL_GetPerformanceCounter() - start;
+
+				emitter.emit( SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2, emitter.getCapacity() - emitter.getCount() );
+			}
+
+			double nanoseconds = ticks * 1000000000.0 / SDL_GetPerformanceFrequency();
+			printf( "%10d %10s %16.3f\n", counts[ c ], names[ k ].c_str(), nanoseconds / ( (double)iterations * counts[ c ] ) );
+		}
+
+		//Time whole steps, refill included, on the worker pool
+		int workerCount = std::max( 1, SDL_GetCPUCount() - 1 );
+		ParticleSimulation simulation( counts[ c ], workerCount );
+		Uint64 start = SDL_GetPerformanceCounter();
+		for( int i = 0; i < iterations; ++i )
+		{
+			simulation.start( SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 );
+			simulation.finish();
+		}
+		double nanoseconds = ( SDL_GetPerformanceCounter() - start ) * 1000000000.0 / SDL_GetPerformanceFrequency();
+		printf( "%10d %7d thr %16.3f\n", counts[ c ], simulation.getWorkerCount(), nanoseconds / ( (double)iterations * counts[ c ] ) );
+	}
+}
+
+ParticleEmitter::ParticleEmitter( int capacity, Uint32 seed )
+{
+	//Allocate all storage up front
+	mPosX.resize( capacity );
+	mPosY.resize( capacity );
+	mFrame.resize( capacity );
+	mType.resize( capacity );
+
+	//Start empty
+	mCount = 0;
+
+	//Use the fastest aging this CPU supports
+	mAgeKernel = getParticleAgeKernel();
+
+	//Xorshift state must not be zero
+	mRandom = seed != 0 ? seed : 1;
+}
+
+int ParticleEmitter::random( int range )
+{
+	//Xorshift32
+	mRandom ^= mRandom << 13;
+	mRandom ^= mRandom >> 17;
+	mRandom ^= mRandom << 5;
+
+	//Scale into range without division
+	return (int)( ( (Uint64)mRandom * (Uint64)range ) >> 32 );
+}
+
+void ParticleEmitter::emit( int x, int y, int count )
+{
+	//Don't go over capacity
+	int end = std::min( mCount + count, getCapacity() );
+
+	for( int i = mCount; i < end; ++i )
+	{
+		//Set offsets
+		mPosX[ i ] = x - 5 + random( 25 );
+		mPosY[ i ] = y - 5 + random( 25 );
+
+		//Initialize animation
+		mFrame[ i ] = random( 5 );
+
+		//Set type
+		mType[ i ] = (Uint8)random( TOTAL_PARTICLE_TYPES );
+	}
+
+	mCount = end;
+}
+
+void ParticleEmitter::update()
+{
+	//Animate
+	int dead = mAgeKernel( &mFrame[ 0 ], mCount, PARTICLE_LIFETIME );
+
+	//Replace dead particles with the last live one, stopping once all are gone
+	int i = 0;
+	while( dead > 0 )
+	{
+		if( mFrame[ i ] > PARTICLE_LIFETIME )
+		{
+			--mCount;
+			--dead;
+			mPosX[ i ] = mPosX[ mCount ];
+			mPosY[ i ] = mPosY[ mCount ];
+			mFrame[ i ] = mFrame[ mCount ];
+			mType[ i ] = mType[ mCount ];
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+void ParticleEmitter::copyTo( ParticleSnapshot& snapshot )
+{
+	//Copy only live particles into preallocated storage
+	std::copy( mPosX.begin(), mPosX.begin() + mCount, snapshot.posX.begin() );
+	std::copy( mPosY.begin(), mPosY.begin() + mCount, snapshot.posY.begin() );
+	std::copy( mFrame.begin(), mFrame.begin() + mCount, snapshot.frame.begin() );
+	std::copy( mType.begin(), mType.begin() + mCount, snapshot.type.begin() );
+	snapshot.count = mCount;
+}
+
+void ParticleEmitter::setAgeKernel( ParticleAgeKernel kernel )
+{
+	mAgeKernel = kernel;
+}
+
+int ParticleEmitter::getCount()
+{
+	return mCount;
+}
+
+int ParticleEmitter::getCapacity()
+{
+	return (int)mFrame.size();
+}
+
+ParticleSimulation::ParticleSimulation( int capacity, int workerCount )
+{
+	//Split particles into chunks with their own random sequence
+	for( int first = 0; first < capacity; first += PARTICLE_CHUNK_SIZE )
+	{
+		int size = std::min( PARTICLE_CHUNK_SIZE, capacity - first );
+		mChunks.push_back( ParticleEmitter( size, 0x9E3779B9 + (Uint32)mChunks.size() * 0x6A09E667 ) );
+
+		//Allocate snapshot storage up front
+		ParticleSnapshot snapshot;
+		snapshot.posX.resize( size );
+		snapshot.posY.resize( size );
+		snapshot.frame.resize( size );
+		snapshot.type.resize( size );
+		snapshot.count = 0;
+		mFront.push_back( snapshot );
+		mBack.push_back( snapshot );
+	}
+
+	//Initialize step state
+	mLock = SDL_CreateMutex();
+	mCanWork = SDL_CreateCond();
+	mDone = SDL_CreateCond();
+	mStep = 0;
+	mRunning = false;
+	mBusyWorkers = 0;
+	SDL_AtomicSet( &mNextChunk, 0 );
+	mSpawnX = 0;
+	mSpawnY = 0;
+	mQuit = false;
+
+	//Extra workers would never find a chunk to claim, and a single chunk is cheaper to step right here
+	workerCount = mChunks.size() > 1 ? std::min( (int)mChunks.size(), workerCount ) : 0;
+
+	//Start the workers
+	for( int i = 0; i < workerCount; ++i )
+	{
+		SDL_Thread* thread = SDL_CreateThread( worker, "ParticleWorker", this );
+		if( thread == NULL )
+		{
+			printf( "Unable to create particle worker! SDL Error: %s\n", SDL_GetError() );
+		}
+		else
+		{
+			mWorkers.push_back( thread );
+		}
+	}
+}
+
+ParticleSimulation::~ParticleSimulation()
+{
+	//Let the running step end
+	finish();
+
+	//Tell workers to exit
+	SDL_LockMutex( mLock );
+	mQuit = true;
+	SDL_CondBroadcast( mCanWork );
+	SDL_UnlockMutex( mLock );
+
+	//Wait for workers to finish
+	for( size_t i = 0; i < mWorkers.size(); ++i )
+	{
+		SDL_WaitThread( mWorkers[ i ], NULL );
+	}
+
+	//Free synchronization
+	SDL_DestroyCond( mDone );
+	SDL_DestroyCond( mCanWork );
+	SDL_DestroyMutex( mLock );
+}
+
+void ParticleSimulation::start( int x, int y )
+{
+	//Only one step runs at a time
+	finish();
+
+	//Publish the step
+	SDL_LockMutex( mLock );
+	mSpawnX = x;
+	mSpawnY = y;
+	SDL_AtomicSet( &mNextChunk, 0 );
+	mStep++;
+	mRunning = true;
+	SDL_UnlockMutex( mLock );
+
+	//Wake the workers
+	if( mWorkers.empty() )
+	{
+		//Run the step here when it has no workers
+		simulateChunks();
+	}
+	else
+	{
+		SDL_CondBroadcast( mCanWork );
+	}
+}
+
+void ParticleSimulation::finish()
+{
+	//Wait until every chunk is claimed and no worker, even one that woke late, is still inside a step
+	SDL_LockMutex( mLock );
+	bool stepped = mRunning;
+	while( ( mRunning && SDL_AtomicGet( &mNextChunk ) < (int)mChunks.size() ) || mBusyWorkers > 0 )
+	{
+		SDL_CondWait( mDone, mLock );
+	}
+	mRunning = false;
+	SDL_UnlockMutex( mLock );
+
+	//Draw the new particles from now on
+	if( stepped )
+	{
+		mFront.swap( mBack );
+	}
+}
+
+int ParticleSimulation::getWorkerCount()
+{
+	return (int)mWorkers.size();
+}
+
+void ParticleSimulation::render()
+{
+	LTexture* texture = gParticleAtlas.getTexture();
+
+	for( size_t c = 0; c < mFront.size(); ++c )
+	{
+		ParticleSnapshot& snapshot = mFront[ c ];
+		for( int i = 0; i < snapshot.count; ++i )
+		{
+			//Show image
+			texture->render( snapshot.posX[ i ], snapshot.posY[ i ], gParticleClips[ snapshot.type[ i ] ] );
+
+			//Show shimmer
+			if( snapshot.frame[ i ] % 2 == 0 )
+			{
+				texture->render( snapshot.posX[ i ], snapshot.posY[ i ], gShimmerClip );
+			}
+		}
+	}
+}
+
+int ParticleSimulation::worker( void* data )
+{
+	ParticleSimulation* simulation = (ParticleSimulation*)data;
+
+	//Last step this worker took part in
+	int seenStep = 0;
+
+	SDL_LockMutex( simulation->mLock );
+	while( true )
+	{
+		//Wait for a new step
+		while( !simulation->mQuit && simulation->mStep == seenStep )
+		{
+			SDL_CondWait( simulation->mCanWork, simulation->mLock );
+		}
+		if( simulation->mQuit )
+		{
+			break;
+		}
+		seenStep = simulation->mStep;
+		simulation->mBusyWorkers++;
+		SDL_UnlockMutex( simulation->mLock );
+
+		//Work without holding the lock
+		simulation->simulateChunks();
+
+		//Report back
+		SDL_LockMutex( simulation->mLock );
+		simulation->mBusyWorkers--;
+		if( simulation->mBusyWorkers == 0 )
+		{
+			SDL_CondSignal( simulation->mDone );
+		}
+	}
+	SDL_UnlockMutex( simulation->mLock );
+
+	return 0;
+}
+
+int ParticleSimulation::simulateChunks()
+{
+	int simulated = 0;
+	while( true )
+	{
+		//Claim the next chunk
+		int c = SDL_AtomicAdd( &mNextChunk, 1 );
+		if( c >= (int)mChunks.size() )
+		{
+			break;
+		}
+
+		//Replace dead particles, keep them for rendering, then animate
+		ParticleEmitter& chunk = mChunks[ c ];
+		chunk.emit( mSpawnX, mSpawnY, chunk.getCapacity() - chunk.getCount() );
+		chunk.copyTo( mBack[ c ] );
+		chunk.update();
+		simulated++;
+	}
+
+	return simulated;
+}
+
+Dot::Dot() : mParticles( TOTAL_PARTICLES, std::max( 1, SDL_GetCPUCount() - 1 ) )
 {
     //Initialize the offsets
     mPosX = 0;
@@ -343,19 +1347,8 @@ Dot::Dot()
     mVelY = 0;
 
     //Initialize particles
-    for( int i = 0; i < TOTAL_PARTICLES; ++i )
-    {
-        particles[ i ] = new Particle( mPosX, mPosY );
-    }
-}
-
-Dot::~Dot()
-{
-    //Delete particles
-    for( int i = 0; i < TOTAL_PARTICLES; ++i )
-    {
-        delete particles[ i ];
-    }
+    mParticles.start( mPosX, mPosY );
+    mParticles.finish();
 }
 
 void Dot::handleEvent( SDL_Event& e )
@@ -420,22 +1413,14 @@ void Dot::render()
 
 void Dot::renderParticles()
 {
-	//Go through particles
-    for( int i = 0; i < TOTAL_PARTICLES; ++i )
-    {
-        //Delete and replace dead particles
-        if( particles[ i ]->isDead() )
-        {
-            delete particles[ i ];
-            particles[ i ] = new Particle( mPosX, mPosY );
-        }
-    }
+	//Take the particles the workers just finished
+	mParticles.finish();
 
-    //Show particles
-    for( int i = 0; i < TOTAL_PARTICLES; ++i )
-    {
-        particles[ i ]->render();
-    }
+	//Simulate the next step while these are drawn
+	mParticles.start( mPosX, mPosY );
+
+	//Show particles
+	mParticles.render();
 }
 
 bool init()
@@ -504,39 +1489,28 @@ bool loadMedia()
 		success = false;
 	}
 
-	//Load red texture
-	if( !gRedTexture.loadFromFile( "Lesson_38/red.bmp" ) )
+	//Pack particle textures into one atlas
+	std::vector<std::string> particlePaths;
+	particlePaths.push_back( "Lesson_38/red.bmp" );
+	particlePaths.push_back( "Lesson_38/green.bmp" );
+	particlePaths.push_back( "Lesson_38/blue.bmp" );
+	particlePaths.push_back( "Lesson_38/shimmer.bmp" );
+	if( !gParticleAtlas.loadFromFiles( particlePaths ) )
 	{
-		printf( "Failed to load red texture!\n" );
+		printf( "Failed to load particle atlas!\n" );
 		success = false;
 	}
-
-	//Load green texture
-	if( !gGreenTexture.loadFromFile( "Lesson_38/green.bmp" ) )
-	{
-		printf( "Failed to load green texture!\n" );
-		success = false;
-	}
-
-	//Load blue texture
-	if( !gBlueTexture.loadFromFile( "Lesson_38/blue.bmp" ) )
-	{
-		printf( "Failed to load blue texture!\n" );
-		success = false;
-	}
-
-	//Load shimmer texture
-	if( !gShimmerTexture.loadFromFile( "Lesson_38/shimmer.bmp" ) )
+	else
 	{
-		printf( "Failed to load shimmer texture!\n" );
-		success = false;
+		//Get particle regions
+		gParticleClips[ 0 ] = gParticleAtlas.getClip( "Lesson_38/red.bmp" );
+		gParticleClips[ 1 ] = gParticleAtlas.getClip( "Lesson_38/green.bmp" );
+		gParticleClips[ 2 ] = gParticleAtlas.getClip( "Lesson_38/blue.bmp" );
+		gShimmerClip = gParticleAtlas.getClip( "Lesson_38/shimmer.bmp" );
+
+		//Set texture transparency
+		gParticleAtlas.getTexture()->setAlpha( 192 );
 	}
-	
-	//Set texture transparency
-	gRedTexture.setAlpha( 192 );
-	gGreenTexture.setAlpha( 192 );
-	gBlueTexture.setAlpha( 192 );
-	gShimmerTexture.setAlpha( 192 );
 
 	return success;
 }
@@ -545,10 +1519,10 @@ void close()
 {
 	//Free loaded images
 	gDotTexture.free();
-	gRedTexture.free();
-	gGreenTexture.free();
-	gBlueTexture.free();
-	gShimmerTexture.free();
+	gParticleAtlas.free();
+
+	//Destroy cached textures before their renderer
+	gTextureCache.clear();
 
 	//Destroy window	
 	SDL_DestroyRenderer( gRenderer );
@@ -563,6 +1537,13 @@ void close()
 
 int main( int argc, char* args[] )
 {
+	//Time the particle kernels instead of running the demo
+	if( argc > 1 && std::string( args[ 1 ] ) == "--benchmark" )
+	{
+		benchmarkParticles();
+		return 0;
+	}
+
 	//Start up SDL and create window
 	if( !init() )
 	{
@@ -1,24 +1,41 @@
-//Using SDL, SDL_image, standard IO, and strings
+//Using SDL, SDL_image, standard IO, strings, file streams, vectors, math, min/max, and memory mapping
 #include <SDL.h>
 #include <SDL_image.h>
 #include <stdio.h>
 #include <string>
 #include <fstream>
+#include <sstream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+//Using memory mapped files
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
-//Screen dimensions constants
-const int LEVEL_WIDTH = 1280;
-const int LEVEL_HEIGHT = 960;
-
 //Tile constants
 const int TILE_WIDTH = 80;
 const int TILE_HEIGHT = 80;
-const int TOTAL_TILES = 192;
 const int TOTAL_TILE_SPRITES = 12;
 
+//Map chunks are 32x32 tiles
+const int TILE_CHUNK_SHIFT = 5;
+const int TILE_CHUNK_SIZE = 1 << TILE_CHUNK_SHIFT;
+
+//Cached tile layer blocks are 8x8 tiles, so a storage chunk holds 4x4 blocks
+const int TILE_BLOCK_SHIFT = 3;
+const int TILE_BLOCK_SIZE = 1 << TILE_BLOCK_SHIFT;
+
 //The different tile sprites
 const int TILE_RED = 0;
 const int TILE_GREEN = 1;
@@ -33,6 +50,18 @@ const int TILE_BOTTOMLEFT = 9;
 const int TILE_LEFT = 10;
 const int TILE_TOPLEFT = 11;
 
+//Type of tiles in chunks that aren't loaded
+const Uint8 TILE_NONE = 0xFF;
+
+//Binary map format
+const Uint32 MAP_VERSION = 1;
+const int MAP_HEADER_SIZE = 24;
+const int MAP_CHUNK_ENTRY_SIZE = 12;
+
+//Ways a binary map chunk can be stored
+const Uint32 MAP_CHUNK_RAW = 0;
+const Uint32 MAP_CHUNK_RLE = 1;
+
 //Texture wrapper class
 class LTexture
 {
@@ -46,6 +75,9 @@ class LTexture
 		//Loads image at specified path
 		bool loadFromFile( std::string path );
 		
+		//Creates blank texture
+		bool createBlank( int width, int height, SDL_TextureAccess access );
+
 		#if defined(SDL_TTF_MAJOR_VERSION)
 		//Creates image from font string
 		bool loadFromRenderedText( std::string textureText, SDL_Color textColor );
@@ -66,10 +98,16 @@ class LTexture
 		//Renders texture at given point
 		void render( int x, int y, SDL_Rect* clip = NULL, double angle = 0.0, SDL_Point* center = NULL, SDL_RendererFlip flip = SDL_FLIP_NONE );
 
+		//Set self as render target
+		void setAsRenderTarget();
+
 		//Gets image dimensions
 		int getWidth();
 		int getHeight();
 
+		//Gets the hardware texture
+		SDL_Texture* getTexture();
+
 	private:
 		//The actual hardware texture
 		SDL_Texture* mTexture;
@@ -79,28 +117,196 @@ class LTexture
 		int mHeight;
 };
 
-//The tile
-class Tile
+//Collects textured quads and draws each run of the same texture with one call
+class LSpriteBatch
 {
 	public:
-		//Initializes position and type
-		Tile( int x, int y, int tileType );
+		//Initializes variables
+		LSpriteBatch();
 
-		//Shows the tile
-		void render( SDL_Rect& camera );
+		//Set color modulation for following sprites
+		void setColor( Uint8 red, Uint8 green, Uint8 blue );
+
+		//Set alpha modulation for following sprites
+		void setAlpha( Uint8 alpha );
 
-		//Get the tile type
-		int getType();
+		//Queues texture at given point, drawing queued sprites first if the texture changes
+		void render( LTexture* texture, int x, int y, SDL_Rect* clip = NULL, double angle = 0.0, SDL_Point* center = NULL, SDL_RendererFlip flip = SDL_FLIP_NONE );
 
-		//Get the collision box
-		SDL_Rect getBox();
+		//Draws queued sprites
+		void flush();
 
 	private:
-		//The attributes of the tile
-		SDL_Rect mBox;
+		//Texture of the queued sprites
+		SDL_Texture* mTexture;
+
+		//Queued quads
+		std::vector<SDL_Vertex> mVertices;
+		std::vector<int> mIndices;
+
+		//Modulation for following sprites
+		SDL_Color mColor;
+};
+
+//Read only memory mapping of a whole file
+class LMappedFile
+{
+	public:
+		//Initializes variables
+		LMappedFile();
+
+		//Unmaps file
+		~LMappedFile();
+
+		//Maps file at specified path
+		bool open( std::string path );
+
+		//Unmaps file
+		void free();
+
+		//Gets mapped bytes
+		const Uint8* getData();
+		size_t getSize();
+
+	private:
+		//The mapped bytes
+		const Uint8* mData;
+		size_t mSize;
+};
+
+//Tile types stored one byte per tile in square chunks that can be loaded and unloaded
+//
+//Binary maps are little endian:
+//	"LMAP", version, columns, rows, chunk size, tile type count (Uint32 each)
+//	tile type table (one TILE_ type per stored value)
+//	chunk directory row by row (Uint32 offset, size, and MAP_CHUNK_ storage each)
+//	chunk data, raw or as ( count, value ) byte runs
+class TileMap
+{
+	public:
+		//Initializes variables
+		TileMap();
+
+		//Deallocates memory
+		~TileMap();
+
+		//Sets map size in tiles with no chunks loaded
+		void create( int columns, int rows );
+
+		//Maps binary map at specified path, reading chunks only when they're loaded
+		bool loadFromFile( std::string path );
+
+		//Writes binary map to specified path
+		bool saveToFile( std::string path );
+
+		//Deallocates all chunks
+		void free();
+
+		//Gets the tile type, TILE_NONE if its chunk isn't loaded
+		Uint8 getType( int column, int row );
+
+		//Sets the tile type, loading its chunk if needed
+		void setType( int column, int row, Uint8 type );
+
+		//Gets the collision box of a tile
+		SDL_Rect getBox( int column, int row );
+
+		//Gets map dimensions in tiles
+		int getColumns();
+		int getRows();
+
+		//Gets the tile types of a chunk, allocating it filled with TILE_NONE if it isn't loaded
+		Uint8* loadChunk( int chunkColumn, int chunkRow );
+
+		//Frees a chunk's tile types
+		void unloadChunk( int chunkColumn, int chunkRow );
+
+		//Checks if a chunk's tile types are in memory
+		bool isChunkLoaded( int chunkColumn, int chunkRow );
+
+		//Gets a number that changes whenever a chunk's tiles change
+		Uint32 getChunkRevision( int chunkColumn, int chunkRow );
+
+		//Loads chunks near area from the binary map and unloads the rest
+		void streamChunks( SDL_Rect area );
+
+	private:
+		//Sizes the chunk table
+		void allocateChunks( int columns, int rows );
+
+		//Decodes a chunk from the binary map
+		bool readChunk( int index, Uint8* chunk );
+
+		//Map dimensions in tiles
+		int mColumns;
+		int mRows;
+
+		//Map dimensions in chunks
+		int mChunkColumns;
+		int mChunkRows;
+
+		//Tile types of each chunk row by row, NULL when not loaded
+		std::vector<Uint8*> mChunks;
+
+		//Indices of the loaded chunks, so streaming doesn't have to scan the whole table
+		std::vector<int> mResidentChunks;
+
+		//Revision of each chunk, taken from a counter that never repeats
+		std::vector<Uint32> mRevisions;
+		Uint32 mNextRevision;
+
+		//Binary map chunks are read from
+		LMappedFile mFile;
+
+		//Tile type of each stored value
+		std::vector<Uint8> mTypeTable;
+};
 
-		//The tile type
-		int mType;
+//Where a moving box first touches something
+struct SweepHit
+{
+	//Fraction of the move made before contact, 1 if nothing was hit
+	float time;
+
+	//Direction of the surface that was hit, 0 on the axis that wasn't blocked
+	int normalX, normalY;
+};
+
+//Tile map pre-rendered into target textures of TILE_BLOCK_SIZE x TILE_BLOCK_SIZE tiles
+class TileLayerCache
+{
+	public:
+		//Initializes variables
+		TileLayerCache();
+
+		//Deallocates textures
+		~TileLayerCache();
+
+		//Draws the blocks the camera can see, baking the ones whose chunk changed
+		void render( TileMap& tiles, SDL_Rect& camera );
+
+		//Deallocates all block textures
+		void free();
+
+		//Re-bakes every block on the next render, for when the renderer dropped the target contents
+		void invalidate();
+
+	private:
+		//Draws a block's tiles into its texture
+		bool bake( TileMap& tiles, int blockColumn, int blockRow );
+
+		//Map dimensions in blocks
+		int mBlockColumns;
+		int mBlockRows;
+
+		//Texture of each block row by row, NULL when not baked
+		std::vector<LTexture*> mBlocks;
+
+		//Indices of the blocks with textures, so eviction doesn't have to scan the whole table
+		std::vector<int> mBakedBlocks;
+
+		//Chunk revision each block was baked from
+		std::vector<Uint32> mBakedRevisions;
 };
 
 //The dot that will move around on the screen
@@ -121,10 +327,10 @@ class Dot
 		void handleEvent( SDL_Event& e );
 
 		//Moves the dot
-		void move( Tile *tiles[] );
+		void move( TileMap& tiles );
 
-		//Centers the camera over the dot
-		void setCamera( SDL_Rect& camera );
+		//Centers the camera over the dot, keeping it inside the map
+		void setCamera( SDL_Rect& camera, TileMap& tiles );
 	
 		//Shows the dot on the screen
 		void render( SDL_Rect& camera );
@@ -141,18 +347,41 @@ class Dot
 bool init();
 
 //Loads media
-bool loadMedia( Tile* tiles[] );
+bool loadMedia( TileMap& tiles );
 
 //Frees media and shuts down SDL
-void close( Tile* tiles[] );
+void close();
 
 //Box collision detector
 bool checkCollision( SDL_Rect a, SDL_Rect b );
 
-//Checks collision box against set of tiles
-bool touchesWall( SDL_Rect box, Tile* tiles[] );
-//Sets tiles from tile map
-bool setTiles( Tile *tiles[] );
+//Gets the grid cells a box covers on a columns x rows tile grid
+void getCoveredTiles( SDL_Rect box, int columns, int rows, int& firstColumn, int& firstRow, int& lastColumn, int& lastRow );
+
+//Gets when a box moving along one axis starts and stops overlapping a target on that axis, false if it never does
+bool sweepAxis( int start, int size, float velocity, int targetStart, int targetSize, float& entry, float& exit );
+
+//Gets when and how a box moving by ( velX, velY ) first touches another box
+SweepHit sweepBox( SDL_Rect box, float velX, float velY, SDL_Rect target );
+
+//Gets when and how a box moving by ( velX, velY ) first touches a wall tile or the level edge
+SweepHit sweepTiles( SDL_Rect box, float velX, float velY, TileMap& tiles );
+
+//Shows only the tiles the camera can see
+void renderTiles( TileMap& tiles, SDL_Rect& camera );
+
+//Times visible tile selection on a large synthetic map
+void benchmarkTileCulling();
+
+//Sets tiles from text tile map, one row of tile numbers per line
+bool setTiles( TileMap& tiles, std::string path );
+
+//Clips tile sprites from the sprite sheet
+void setTileClips();
+
+//Reads and writes little endian numbers
+Uint32 readUint32( const Uint8* bytes );
+void writeUint32( std::vector<Uint8>& bytes, Uint32 value );
 
 //The window we'll be rendering to
 SDL_Window* gWindow = NULL;
@@ -164,6 +393,12 @@ SDL_Renderer* gRenderer = NULL;
 LTexture gDotTexture;
 LTexture gTileTexture;
 
+//Batches scene sprites
+LSpriteBatch gSpriteBatch;
+
+//Pre-rendered level
+TileLayerCache gTileCache;
+
 //Clips
 SDL_Rect gTileClips[ TOTAL_TILE_SPRITES ];
 
@@ -222,6 +457,26 @@ bool LTexture::loadFromFile( std::string path )
 	return mTexture != NULL;
 }
 
+bool LTexture::createBlank( int width, int height, SDL_TextureAccess access )
+{
+	//Get rid of preexisting texture
+	free();
+
+	//Create uninitialized texture
+	mTexture = SDL_CreateTexture( gRenderer, SDL_PIXELFORMAT_RGBA8888, access, width, height );
+	if( mTexture == NULL )
+	{
+		printf( "Unable to create blank texture! SDL Error: %s\n", SDL_GetError() );
+	}
+	else
+	{
+		mWidth = width;
+		mHeight = height;
+	}
+
+	return mTexture != NULL;
+}
+
 #if defined(SDL_TTF_MAJOR_VERSION)
 bool LTexture::loadFromRenderedText( std::string textureText, SDL_Color textColor )
 {
@@ -305,6 +560,12 @@ void LTexture::render( int x, int y, SDL_Rect* clip, double angle, SDL_Point* ce
 	SDL_RenderCopyEx( gRenderer, mTexture, clip, &renderQuad, angle, center, flip );
 }
 
+void LTexture::setAsRenderTarget()
+{
+	//Make self render target
+	SDL_SetRenderTarget( gRenderer, mTexture );
+}
+
 int LTexture::getWidth()
 {
 	return mWidth;
@@ -315,6 +576,126 @@ int LTexture::getHeight()
 	return mHeight;
 }
 
+SDL_Texture* LTexture::getTexture()
+{
+	return mTexture;
+}
+
+LSpriteBatch::LSpriteBatch()
+{
+	//Initialize
+	mTexture = NULL;
+	mColor.r = 0xFF;
+	mColor.g = 0xFF;
+	mColor.b = 0xFF;
+	mColor.a = 0xFF;
+}
+
+void LSpriteBatch::setColor( Uint8 red, Uint8 green, Uint8 blue )
+{
+	mColor.r = red;
+	mColor.g = green;
+	mColor.b = blue;
+}
+
+void LSpriteBatch::setAlpha( Uint8 alpha )
+{
+	mColor.a = alpha;
+}
+
+void LSpriteBatch::render( LTexture* texture, int x, int y, SDL_Rect* clip, double angle, SDL_Point* center, SDL_RendererFlip flip )
+{
+	//Draw what was queued before switching textures
+	if( texture->getTexture() != mTexture )
+	{
+		flush();
+		mTexture = texture->getTexture();
+	}
+
+	//Source region in texel space
+	float textureW = (float)texture->getWidth();
+	float textureH = (float)texture->getHeight();
+	SDL_Rect source = { 0, 0, texture->getWidth(), texture->getHeight() };
+	if( clip != NULL )
+	{
+		source = *clip;
+	}
+
+	//Texture coordinates of the quad corners
+	float u0 = source.x / textureW;
+	float v0 = source.y / textureH;
+	float u1 = ( source.x + source.w ) / textureW;
+	float v1 = ( source.y + source.h ) / textureH;
+	if( flip & SDL_FLIP_HORIZONTAL )
+	{
+		std::swap( u0, u1 );
+	}
+	if( flip & SDL_FLIP_VERTICAL )
+	{
+		std::swap( v0, v1 );
+	}
+
+	//Rotation center relative to the quad, defaulting to its middle
+	float centerX = source.w / 2.f;
+	float centerY = source.h / 2.f;
+	if( center != NULL )
+	{
+		centerX = (float)center->x;
+		centerY = (float)center->y;
+	}
+
+	//Clockwise rotation like SDL_RenderCopyEx
+	float radians = (float)( angle * M_PI / 180.0 );
+	float cosine = cosf( radians );
+	float sine = sinf( radians );
+
+	//Quad corners clockwise from the top left
+	float cornersX[ 4 ] = { 0.f, (float)source.w, (float)source.w, 0.f };
+	float cornersY[ 4 ] = { 0.f, 0.f, (float)source.h, (float)source.h };
+	float cornersU[ 4 ] = { u0, u1, u1, u0 };
+	float cornersV[ 4 ] = { v0, v0, v1, v1 };
+
+	//Queue the corners
+	int first = (int)mVertices.size();
+	for( int i = 0; i < 4; ++i )
+	{
+		float dx = cornersX[ i ] - centerX;
+		float dy = cornersY[ i ] - centerY;
+
+		SDL_Vertex vertex;
+		vertex.position.x = x + centerX + dx * cosine - dy * sine;
+		vertex.position.y = y + centerY + dx * sine + dy * cosine;
+		vertex.color = mColor;
+		vertex.tex_coord.x = cornersU[ i ];
+		vertex.tex_coord.y = cornersV[ i ];
+		mVertices.push_back( vertex );
+	}
+
+	//Two triangles per quad
+	mIndices.push_back( first );
+	mIndices.push_back( first + 1 );
+	mIndices.push_back( first + 2 );
+	mIndices.push_back( first + 2 );
+	mIndices.push_back( first + 3 );
+	mIndices.push_back( first );
+}
+
+void LSpriteBatch::flush()
+{
+	//Draw queued sprites in one call
+	if( !mIndices.empty() )
+	{
+		if( SDL_RenderGeometry( gRenderer, mTexture, &mVertices[ 0 ], (int)mVertices.size(), &mIndices[ 0 ], (int)mIndices.size() ) < 0 )
+		{
+			printf( "Unable to render sprite batch! SDL Error: %s\n", SDL_GetError() );
+		}
+	}
+
+	//Keep the storage for the next frame
+	mVertices.clear();
+	mIndices.clear();
+}
+
 Dot::Dot()
 {
   //Initialize the collision box
@@ -356,183 +737,767 @@ void Dot::handleEvent( SDL_Event& e )
     }
 }
 
-void Dot::move( Tile *tiles[] )
+void Dot::move( TileMap& tiles )
 {
-    //Move the dot left or right
-    mBox.x += mVelX;
-
-    //If the dot went too far to the left or right or touched a wall
-    if( ( mBox.x < 0 ) || ( mBox.x + DOT_WIDTH > LEVEL_WIDTH ) || touchesWall( mBox, tiles ) )
-    {
-        //move back
-        mBox.x -= mVelX;
-    }
+    //Distance left to move
+    int moveX = mVelX;
+    int moveY = mVelY;
 
-    //Move the dot up or down
-    mBox.y += mVelY;
-
-    //If the dot went too far up or down or touched a wall
-    if( ( mBox.y < 0 ) || ( mBox.y + DOT_HEIGHT > LEVEL_HEIGHT ) || touchesWall( mBox, tiles ) )
+    //Slide along walls, each pass blocks at least one axis
+    for( int pass = 0; pass < 3 && ( moveX != 0 || moveY != 0 ); ++pass )
     {
-        //move back
-        mBox.y -= mVelY;
+        SweepHit hit = sweepTiles( mBox, (float)moveX, (float)moveY, tiles );
+
+        //Walls sit on whole pixels, so the blocked axis rounds to the exact gap
+        //and the free axis rounds toward the start to stay out of walls
+        int stepX = hit.normalX != 0 ? (int)std::lround( moveX * hit.time ) : (int)( moveX * hit.time );
+        int stepY = hit.normalY != 0 ? (int)std::lround( moveY * hit.time ) : (int)( moveY * hit.time );
+        mBox.x += stepX;
+        mBox.y += stepY;
+        moveX -= stepX;
+        moveY -= stepY;
+
+        //Stop moving into the wall
+        if( hit.normalX != 0 )
+        {
+            moveX = 0;
+        }
+        if( hit.normalY != 0 )
+        {
+            moveY = 0;
+        }
     }
 }
 
-void Dot::setCamera( SDL_Rect& camera )
+void Dot::setCamera( SDL_Rect& camera, TileMap& tiles )
 {
 	//Center the camera over the dot
 	camera.x = ( mBox.x + DOT_WIDTH / 2 ) - SCREEN_WIDTH / 2;
 	camera.y = ( mBox.y + DOT_HEIGHT / 2 ) - SCREEN_WIDTH / 2;
 
-	//Keep the camera in bounds
-	if( camera.x < 0 )
+	//Keep the camera in the same bounds the dot moves in, pinned to the top left on maps smaller than the screen
+	int levelWidth = tiles.getColumns() * TILE_WIDTH;
+	int levelHeight = tiles.getRows() * TILE_HEIGHT;
+	if( camera.x > levelWidth - camera.w )
 	{
-		camera.x = 0;
+		camera.x = levelWidth - camera.w;
 	}
-	if( camera.y < 0 )
+	if( camera.y > levelHeight - camera.h )
 	{
-		camera.y = 0;
+		camera.y = levelHeight - camera.h;
 	}
-	if( camera.x > LEVEL_WIDTH - camera.w )
+	if( camera.x < 0 )
 	{
-		camera.x = LEVEL_WIDTH - camera.w;
+		camera.x = 0;
 	}
-	if( camera.y > LEVEL_HEIGHT - camera.h )
+	if( camera.y < 0 )
 	{
-		camera.y = LEVEL_HEIGHT - camera.h;
+		camera.y = 0;
 	}
 }
 
 void Dot::render( SDL_Rect& camera )
 {
     //Show the dot
-	gDotTexture.render( mBox.x - camera.x, mBox.y - camera.y  );
-}
-
-Tile::Tile( int x, int y, int tileType )
-{
-	//Get the offsets
-	mBox.x = x;
-	mBox.y = y;
-
-	//Set the collision box
-	mBox.w = TILE_WIDTH;
-	mBox.h = TILE_HEIGHT;
-
-	//Get the tile type
-	mType = tileType;
-}
-
-void Tile::render( SDL_Rect& camera )
-{
-	//If the tile is on screen
-	if( checkCollision( camera, mBox ) )
-	{
-		//Show the tile
-		gTileTexture.render( mBox.x - camera.x, mBox.y - camera.y, &gTileClips[ mType ] );
-	}
+	gSpriteBatch.render( &gDotTexture, mBox.x - camera.x, mBox.y - camera.y  );
 }
 
-int Tile::getType()
+LMappedFile::LMappedFile()
 {
-	return mType;
+	//Initialize
+	mData = NULL;
+	mSize = 0;
 }
 
-SDL_Rect Tile::getBox()
+LMappedFile::~LMappedFile()
 {
-	return mBox;
+	//Deallocate
+	free();
 }
 
-bool init()
+bool LMappedFile::open( std::string path )
 {
-	//Initialization flag
-	bool success = true;
+	//Get rid of preexisting mapping
+	free();
 
-	//Initialize SDL
-	if( SDL_Init( SDL_INIT_VIDEO ) < 0 )
+	#if defined( _WIN32 )
+	//Open file
+	HANDLE file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( file == INVALID_HANDLE_VALUE )
 	{
-		printf( "SDL could not initialize! SDL Error: %s\n", SDL_GetError() );
-		success = false;
+		printf( "Unable to open %s!\n", path.c_str() );
+		return false;
 	}
-	else
+
+	//Map the whole file, the view keeps it open
+	LARGE_INTEGER size;
+	if( GetFileSizeEx( file, &size ) && size.QuadPart > 0 )
 	{
-		//Set texture filtering to linear
-		if( !SDL_SetHint( SDL_HINT_RENDER_SCALE_QUALITY, "1" ) )
+		HANDLE mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+		if( mapping != NULL )
 		{
-			printf( "Warning: Linear texture filtering not enabled!" );
+			mData = (const Uint8*)MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+			mSize = mData != NULL ? (size_t)size.QuadPart : 0;
+			CloseHandle( mapping );
 		}
+	}
+	CloseHandle( file );
+	#else
+	//Open file
+	int file = ::open( path.c_str(), O_RDONLY );
+	if( file < 0 )
+	{
+		printf( "Unable to open %s!\n", path.c_str() );
+		return false;
+	}
 
-		//Create window
-		gWindow = SDL_CreateWindow( "SDL Tutorial", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN );
-		if( gWindow == NULL )
+	//Map the whole file, the mapping keeps it open
+	struct stat info;
+	if( fstat( file, &info ) == 0 && info.st_size > 0 )
+	{
+		void* data = mmap( NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0 );
+		if( data != MAP_FAILED )
 		{
-			printf( "Window could not be created! SDL Error: %s\n", SDL_GetError() );
-			success = false;
+			mData = (const Uint8*)data;
+			mSize = (size_t)info.st_size;
 		}
-		else
-		{
-			//Create renderer for window
-			gRenderer = SDL_CreateRenderer( gWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC );
-			if( gRenderer == NULL )
-			{
-				printf( "Renderer could not be created! SDL Error: %s\n", SDL_GetError() );
-				success = false;
-			}
-			else
-			{
-				//Initialize renderer color
-				SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
+	}
+	::close( file );
+	#endif
 
-				//Initialize PNG loading
-				int imgFlags = IMG_INIT_PNG;
-				if( !( IMG_Init( imgFlags ) & imgFlags ) )
-				{
-					printf( "SDL_image could not initialize! SDL_image Error: %s\n", IMG_GetError() );
-					success = false;
-				}
-			}
-		}
+	if( mData == NULL )
+	{
+		printf( "Unable to map %s!\n", path.c_str() );
 	}
 
-	return success;
+	return mData != NULL;
 }
 
-bool loadMedia( Tile* tiles[] )
+void LMappedFile::free()
 {
-	//Loading success flag
-	bool success = true;
-
-	//Load dot texture
-	if( !gDotTexture.loadFromFile( "Lesson_39/dot.bmp" ) )
+	//Unmap file if it is mapped
+	if( mData != NULL )
 	{
-		printf( "Failed to load dot texture!\n" );
-		success = false;
+		#if defined( _WIN32 )
+		UnmapViewOfFile( mData );
+		#else
+		munmap( (void*)mData, mSize );
+		#endif
+		mData = NULL;
+		mSize = 0;
 	}
+}
 
-	//Load tile texture
-	if( !gTileTexture.loadFromFile( "Lesson_39/tiles.png" ) )
-	{
-		printf( "Failed to load tiles texture!\n" );
-		success = false;
-	}
+const Uint8* LMappedFile::getData()
+{
+	return mData;
+}
 
-  //Load tile map
-  if( !setTiles( tiles ) )
-  {
-  	printf( "Failde to load tile set!\n" );
-  	success = false;
-  }
-	return success;
+size_t LMappedFile::getSize()
+{
+	return mSize;
 }
 
-bool checkCollision( SDL_Rect a, SDL_Rect b )
+TileMap::TileMap()
 {
-    //The sides of the rectangles
-    int leftA, leftB;
-    int rightA, rightB;
-    int topA, topB;
-    int bottomA, bottomB;
+	//Initialize
+	mColumns = 0;
+	mRows = 0;
+	mChunkColumns = 0;
+	mChunkRows = 0;
+	mNextRevision = 1;
+}
+
+TileMap::~TileMap()
+{
+	//Deallocate
+	free();
+}
+
+void TileMap::create( int columns, int rows )
+{
+	//Get rid of preexisting map
+	free();
+
+	allocateChunks( columns, rows );
+}
+
+void TileMap::allocateChunks( int columns, int rows )
+{
+	//Round chunk counts up to cover the whole map
+	mColumns = columns;
+	mRows = rows;
+	mChunkColumns = ( columns + TILE_CHUNK_SIZE - 1 ) >> TILE_CHUNK_SHIFT;
+	mChunkRows = ( rows + TILE_CHUNK_SIZE - 1 ) >> TILE_CHUNK_SHIFT;
+	mChunks.assign( mChunkColumns * mChunkRows, (Uint8*)NULL );
+
+	//New chunks don't match anything drawn from an older map
+	mRevisions.assign( mChunkColumns * mChunkRows, mNextRevision++ );
+}
+
+bool TileMap::loadFromFile( std::string path )
+{
+	//Get rid of preexisting map
+	free();
+
+	//Map the file
+	if( !mFile.open( path ) )
+	{
+		return false;
+	}
+	const Uint8* data = mFile.getData();
+	size_t size = mFile.getSize();
+
+	//Check the header
+	if( size < (size_t)MAP_HEADER_SIZE || data[ 0 ] != 'L' || data[ 1 ] != 'M' || data[ 2 ] != 'A' || data[ 3 ] != 'P' )
+	{
+		printf( "%s is not a binary map!\n", path.c_str() );
+		free();
+		return false;
+	}
+	Uint32 version = readUint32( data + 4 );
+	Uint32 columns = readUint32( data + 8 );
+	Uint32 rows = readUint32( data + 12 );
+	Uint32 chunkSize = readUint32( data + 16 );
+	Uint32 typeCount = readUint32( data + 20 );
+	if( version != MAP_VERSION || chunkSize != (Uint32)TILE_CHUNK_SIZE || columns == 0 || rows == 0 || columns > 0xFFFF || rows > 0xFFFF || typeCount > 0xFF )
+	{
+		printf( "Unsupported binary map %s (version %u, chunk size %u)!\n", path.c_str(), version, chunkSize );
+		free();
+		return false;
+	}
+
+	//Check the tables fit
+	allocateChunks( columns, rows );
+	if( size < MAP_HEADER_SIZE + typeCount + mChunks.size() * MAP_CHUNK_ENTRY_SIZE )
+	{
+		printf( "Binary map %s is truncated!\n", path.c_str() );
+		free();
+		return false;
+	}
+
+	//Read the tile type table
+	mTypeTable.assign( data + MAP_HEADER_SIZE, data + MAP_HEADER_SIZE + typeCount );
+	for( size_t i = 0; i < mTypeTable.size(); ++i )
+	{
+		if( mTypeTable[ i ] >= TOTAL_TILE_SPRITES )
+		{
+			printf( "Binary map %s has invalid tile type %d!\n", path.c_str(), mTypeTable[ i ] );
+			free();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool TileMap::saveToFile( std::string path )
+{
+	//Write the header
+	std::vector<Uint8> bytes;
+	bytes.push_back( 'L' );
+	bytes.push_back( 'M' );
+	bytes.push_back( 'A' );
+	bytes.push_back( 'P' );
+	writeUint32( bytes, MAP_VERSION );
+	writeUint32( bytes, mColumns );
+	writeUint32( bytes, mRows );
+	writeUint32( bytes, TILE_CHUNK_SIZE );
+
+	//Stored values are the tile types themselves
+	writeUint32( bytes, TOTAL_TILE_SPRITES );
+	for( int i = 0; i < TOTAL_TILE_SPRITES; ++i )
+	{
+		bytes.push_back( (Uint8)i );
+	}
+
+	//Leave room for the chunk directory
+	size_t directory = bytes.size();
+	bytes.resize( directory + mChunks.size() * MAP_CHUNK_ENTRY_SIZE );
+
+	for( size_t i = 0; i < mChunks.size(); ++i )
+	{
+		//Chunks that were never set are empty
+		std::vector<Uint8> tiles( TILE_CHUNK_SIZE * TILE_CHUNK_SIZE, TILE_NONE );
+		int chunkColumn = (int)i % mChunkColumns;
+		int chunkRow = (int)i / mChunkColumns;
+		if( isChunkLoaded( chunkColumn, chunkRow ) )
+		{
+			Uint8* chunk = loadChunk( chunkColumn, chunkRow );
+			tiles.assign( chunk, chunk + TILE_CHUNK_SIZE * TILE_CHUNK_SIZE );
+		}
+
+		//Run length encode the chunk
+		std::vector<Uint8> runs;
+		for( size_t t = 0; t < tiles.size(); )
+		{
+			size_t length = 1;
+			while( t + length < tiles.size() && length < 0xFF && tiles[ t + length ] == tiles[ t ] )
+			{
+				length++;
+			}
+			runs.push_back( (Uint8)length );
+			runs.push_back( tiles[ t ] );
+			t += length;
+		}
+
+		//Keep whichever storage is smaller
+		Uint32 storage = runs.size() < tiles.size() ? MAP_CHUNK_RLE : MAP_CHUNK_RAW;
+		std::vector<Uint8>& stored = storage == MAP_CHUNK_RLE ? runs : tiles;
+
+		//Fill in the directory entry
+		std::vector<Uint8> entry;
+		writeUint32( entry, (Uint32)bytes.size() );
+		writeUint32( entry, (Uint32)stored.size() );
+		writeUint32( entry, storage );
+		std::copy( entry.begin(), entry.end(), bytes.begin() + directory + i * MAP_CHUNK_ENTRY_SIZE );
+
+		bytes.insert( bytes.end(), stored.begin(), stored.end() );
+	}
+
+	//Open file for writing in binary
+	SDL_RWops* file = SDL_RWFromFile( path.c_str(), "w+b" );
+	if( file == NULL )
+	{
+		printf( "Unable to create %s! SDL Error: %s\n", path.c_str(), SDL_GetError() );
+		return false;
+	}
+
+	//Write everything at once
+	bool success = SDL_RWwrite( file, &bytes[ 0 ], bytes.size(), 1 ) == 1;
+	if( !success )
+	{
+		printf( "Unable to write %s! SDL Error: %s\n", path.c_str(), SDL_GetError() );
+	}
+	SDL_RWclose( file );
+
+	return success;
+}
+
+bool TileMap::readChunk( int index, Uint8* chunk )
+{
+	const Uint8* data = mFile.getData();
+	size_t size = mFile.getSize();
+
+	//Find the chunk in the directory
+	const Uint8* entry = data + MAP_HEADER_SIZE + mTypeTable.size() + index * MAP_CHUNK_ENTRY_SIZE;
+	Uint32 offset = readUint32( entry );
+	Uint32 length = readUint32( entry + 4 );
+	Uint32 storage = readUint32( entry + 8 );
+	if( offset > size || length > size - offset )
+	{
+		printf( "Binary map chunk %d is out of bounds!\n", index );
+		return false;
+	}
+
+	//Touch only this chunk's pages
+	const Uint8* stored = data + offset;
+	int tile = 0;
+	if( storage == MAP_CHUNK_RAW && length == TILE_CHUNK_SIZE * TILE_CHUNK_SIZE )
+	{
+		std::copy( stored, stored + length, chunk );
+		tile = length;
+	}
+	else if( storage == MAP_CHUNK_RLE )
+	{
+		for( Uint32 i = 0; i + 1 < length; i += 2 )
+		{
+			int end = std::min( tile + stored[ i ], TILE_CHUNK_SIZE * TILE_CHUNK_SIZE );
+			std::fill( chunk + tile, chunk + end, stored[ i + 1 ] );
+			tile = end;
+		}
+	}
+
+	if( tile != TILE_CHUNK_SIZE * TILE_CHUNK_SIZE )
+	{
+		printf( "Binary map chunk %d is corrupt!\n", index );
+		return false;
+	}
+
+	//Turn stored values into tile types
+	for( tile = 0; tile < TILE_CHUNK_SIZE * TILE_CHUNK_SIZE; ++tile )
+	{
+		chunk[ tile ] = chunk[ tile ] < mTypeTable.size() ? mTypeTable[ chunk[ tile ] ] : TILE_NONE;
+	}
+
+	return true;
+}
+
+void TileMap::free()
+{
+	//Deallocate loaded chunks
+	for( size_t i = 0; i < mChunks.size(); ++i )
+	{
+		delete[] mChunks[ i ];
+	}
+	mChunks.clear();
+	mResidentChunks.clear();
+	mRevisions.clear();
+
+	//Unmap binary map
+	mFile.free();
+	mTypeTable.clear();
+
+	mColumns = 0;
+	mRows = 0;
+	mChunkColumns = 0;
+	mChunkRows = 0;
+}
+
+Uint8 TileMap::getType( int column, int row )
+{
+	//Find the chunk
+	Uint8* chunk = mChunks[ ( row >> TILE_CHUNK_SHIFT ) * mChunkColumns + ( column >> TILE_CHUNK_SHIFT ) ];
+	if( chunk == NULL )
+	{
+		return TILE_NONE;
+	}
+
+	//Find the tile in the chunk
+	return chunk[ ( ( row & ( TILE_CHUNK_SIZE - 1 ) ) << TILE_CHUNK_SHIFT ) + ( column & ( TILE_CHUNK_SIZE - 1 ) ) ];
+}
+
+void TileMap::setType( int column, int row, Uint8 type )
+{
+	Uint8* chunk = loadChunk( column >> TILE_CHUNK_SHIFT, row >> TILE_CHUNK_SHIFT );
+	Uint8& tile = chunk[ ( ( row & ( TILE_CHUNK_SIZE - 1 ) ) << TILE_CHUNK_SHIFT ) + ( column & ( TILE_CHUNK_SIZE - 1 ) ) ];
+	if( tile != type )
+	{
+		tile = type;
+		mRevisions[ ( row >> TILE_CHUNK_SHIFT ) * mChunkColumns + ( column >> TILE_CHUNK_SHIFT ) ] = mNextRevision++;
+	}
+}
+
+SDL_Rect TileMap::getBox( int column, int row )
+{
+	SDL_Rect box = { column * TILE_WIDTH, row * TILE_HEIGHT, TILE_WIDTH, TILE_HEIGHT };
+	return box;
+}
+
+int TileMap::getColumns()
+{
+	return mColumns;
+}
+
+int TileMap::getRows()
+{
+	return mRows;
+}
+
+Uint8* TileMap::loadChunk( int chunkColumn, int chunkRow )
+{
+	//Allocate chunk on first use
+	int index = chunkRow * mChunkColumns + chunkColumn;
+	Uint8*& chunk = mChunks[ index ];
+	if( chunk == NULL )
+	{
+		chunk = new Uint8[ TILE_CHUNK_SIZE * TILE_CHUNK_SIZE ];
+
+		//Read tiles from the binary map if there is one
+		if( mFile.getData() == NULL || !readChunk( index, chunk ) )
+		{
+			std::fill( chunk, chunk + TILE_CHUNK_SIZE * TILE_CHUNK_SIZE, TILE_NONE );
+		}
+		mRevisions[ index ] = mNextRevision++;
+		mResidentChunks.push_back( index );
+	}
+
+	return chunk;
+}
+
+void TileMap::unloadChunk( int chunkColumn, int chunkRow )
+{
+	//Free chunk storage
+	int index = chunkRow * mChunkColumns + chunkColumn;
+	Uint8*& chunk = mChunks[ index ];
+	if( chunk != NULL )
+	{
+		delete[] chunk;
+		chunk = NULL;
+		mRevisions[ index ] = mNextRevision++;
+
+		//Order of the resident list doesn't matter
+		std::vector<int>::iterator resident = std::find( mResidentChunks.begin(), mResidentChunks.end(), index );
+		*resident = mResidentChunks.back();
+		mResidentChunks.pop_back();
+	}
+}
+
+bool TileMap::isChunkLoaded( int chunkColumn, int chunkRow )
+{
+	return mChunks[ chunkRow * mChunkColumns + chunkColumn ] != NULL;
+}
+
+Uint32 TileMap::getChunkRevision( int chunkColumn, int chunkRow )
+{
+	return mRevisions[ chunkRow * mChunkColumns + chunkColumn ];
+}
+
+void TileMap::streamChunks( SDL_Rect area )
+{
+	//Chunks the area covers plus one on every side
+	int firstColumn, firstRow, lastColumn, lastRow;
+	getCoveredTiles( area, mColumns, mRows, firstColumn, firstRow, lastColumn, lastRow );
+	int firstChunkColumn = std::max( ( firstColumn >> TILE_CHUNK_SHIFT ) - 1, 0 );
+	int firstChunkRow = std::max( ( firstRow >> TILE_CHUNK_SHIFT ) - 1, 0 );
+	int lastChunkColumn = std::min( ( lastColumn >> TILE_CHUNK_SHIFT ) + 1, mChunkColumns - 1 );
+	int lastChunkRow = std::min( ( lastRow >> TILE_CHUNK_SHIFT ) + 1, mChunkRows - 1 );
+
+	//Drop resident chunks that moved out of range, only when they can be read back from the file
+	if( mFile.getData() != NULL )
+	{
+		for( size_t i = mResidentChunks.size(); i-- > 0; )
+		{
+			int chunkColumn = mResidentChunks[ i ] % mChunkColumns;
+			int chunkRow = mResidentChunks[ i ] / mChunkColumns;
+			bool near = chunkColumn >= firstChunkColumn && chunkColumn <= lastChunkColumn && chunkRow >= firstChunkRow && chunkRow <= lastChunkRow;
+			if( !near )
+			{
+				unloadChunk( chunkColumn, chunkRow );
+			}
+		}
+	}
+
+	//Load the chunks in range
+	for( int chunkRow = firstChunkRow; chunkRow <= lastChunkRow; ++chunkRow )
+	{
+		for( int chunkColumn = firstChunkColumn; chunkColumn <= lastChunkColumn; ++chunkColumn )
+		{
+			loadChunk( chunkColumn, chunkRow );
+		}
+	}
+}
+
+TileLayerCache::TileLayerCache()
+{
+	//Initialize
+	mBlockColumns = 0;
+	mBlockRows = 0;
+}
+
+TileLayerCache::~TileLayerCache()
+{
+	//Deallocate
+	free();
+}
+
+void TileLayerCache::free()
+{
+	//Deallocate baked blocks
+	for( size_t i = 0; i < mBlocks.size(); ++i )
+	{
+		delete mBlocks[ i ];
+	}
+	mBlocks.clear();
+	mBakedBlocks.clear();
+	mBakedRevisions.clear();
+
+	mBlockColumns = 0;
+	mBlockRows = 0;
+}
+
+void TileLayerCache::invalidate()
+{
+	//Chunk revisions start at 1, so nothing matches 0
+	std::fill( mBakedRevisions.begin(), mBakedRevisions.end(), 0 );
+}
+
+bool TileLayerCache::bake( TileMap& tiles, int blockColumn, int blockRow )
+{
+	//Part of the level the block covers, smaller at the right and bottom edges
+	SDL_Rect area;
+	area.x = blockColumn * TILE_BLOCK_SIZE * TILE_WIDTH;
+	area.y = blockRow * TILE_BLOCK_SIZE * TILE_HEIGHT;
+	area.w = std::min( TILE_BLOCK_SIZE, tiles.getColumns() - blockColumn * TILE_BLOCK_SIZE ) * TILE_WIDTH;
+	area.h = std::min( TILE_BLOCK_SIZE, tiles.getRows() - blockRow * TILE_BLOCK_SIZE ) * TILE_HEIGHT;
+
+	//Create the target texture once and reuse it on later bakes
+	LTexture*& block = mBlocks[ blockRow * mBlockColumns + blockColumn ];
+	if( block == NULL )
+	{
+		block = new LTexture;
+		if( !block->createBlank( area.w, area.h, SDL_TEXTUREACCESS_TARGET ) )
+		{
+			delete block;
+			block = NULL;
+			return false;
+		}
+		block->setBlendMode( SDL_BLENDMODE_BLEND );
+		mBakedBlocks.push_back( blockRow * mBlockColumns + blockColumn );
+	}
+
+	//Sprites queued for the screen have to be drawn before switching targets
+	gSpriteBatch.flush();
+
+	//Clear block to transparent so unloaded tiles show the background
+	block->setAsRenderTarget();
+	SDL_SetRenderDrawColor( gRenderer, 0x00, 0x00, 0x00, 0x00 );
+	SDL_RenderClear( gRenderer );
+
+	//Draw the block's tiles
+	renderTiles( tiles, area );
+	gSpriteBatch.flush();
+
+	//Reset render target
+	SDL_SetRenderTarget( gRenderer, NULL );
+
+	return true;
+}
+
+void TileLayerCache::render( TileMap& tiles, SDL_Rect& camera )
+{
+	//Start over if the map size changed
+	int blockColumns = ( tiles.getColumns() + TILE_BLOCK_SIZE - 1 ) >> TILE_BLOCK_SHIFT;
+	int blockRows = ( tiles.getRows() + TILE_BLOCK_SIZE - 1 ) >> TILE_BLOCK_SHIFT;
+	if( blockColumns != mBlockColumns || blockRows != mBlockRows )
+	{
+		free();
+		mBlockColumns = blockColumns;
+		mBlockRows = blockRows;
+		mBlocks.assign( mBlockColumns * mBlockRows, (LTexture*)NULL );
+		mBakedRevisions.assign( mBlockColumns * mBlockRows, 0 );
+	}
+
+	//Blocks on screen
+	int firstColumn, firstRow, lastColumn, lastRow;
+	getCoveredTiles( camera, tiles.getColumns(), tiles.getRows(), firstColumn, firstRow, lastColumn, lastRow );
+	int firstBlockColumn = firstColumn >> TILE_BLOCK_SHIFT;
+	int firstBlockRow = firstRow >> TILE_BLOCK_SHIFT;
+	int lastBlockColumn = lastColumn >> TILE_BLOCK_SHIFT;
+	int lastBlockRow = lastRow >> TILE_BLOCK_SHIFT;
+
+	//Keep one block around the screen baked, drop the rest
+	for( size_t i = mBakedBlocks.size(); i-- > 0; )
+	{
+		int index = mBakedBlocks[ i ];
+		int blockColumn = index % mBlockColumns;
+		int blockRow = index / mBlockColumns;
+		bool near = blockColumn >= firstBlockColumn - 1 && blockColumn <= lastBlockColumn + 1 && blockRow >= firstBlockRow - 1 && blockRow <= lastBlockRow + 1;
+		if( !near )
+		{
+			delete mBlocks[ index ];
+			mBlocks[ index ] = NULL;
+			mBakedBlocks[ i ] = mBakedBlocks.back();
+			mBakedBlocks.pop_back();
+		}
+	}
+
+	for( int blockRow = firstBlockRow; blockRow <= lastBlockRow; ++blockRow )
+	{
+		for( int blockColumn = firstBlockColumn; blockColumn <= lastBlockColumn; ++blockColumn )
+		{
+			int index = blockRow * mBlockColumns + blockColumn;
+
+			//Re-bake only blocks whose chunk changed since they were drawn
+			Uint32 revision = tiles.getChunkRevision( blockColumn >> ( TILE_CHUNK_SHIFT - TILE_BLOCK_SHIFT ), blockRow >> ( TILE_CHUNK_SHIFT - TILE_BLOCK_SHIFT ) );
+			if( mBlocks[ index ] == NULL || mBakedRevisions[ index ] != revision )
+			{
+				if( !bake( tiles, blockColumn, blockRow ) )
+				{
+					continue;
+				}
+				mBakedRevisions[ index ] = revision;
+			}
+
+			//Draw the whole block as one quad
+			gSpriteBatch.render( mBlocks[ index ], blockColumn * TILE_BLOCK_SIZE * TILE_WIDTH - camera.x, blockRow * TILE_BLOCK_SIZE * TILE_HEIGHT - camera.y );
+		}
+	}
+}
+
+bool init()
+{
+	//Initialization flag
+	bool success = true;
+
+	//Initialize SDL
+	if( SDL_Init( SDL_INIT_VIDEO ) < 0 )
+	{
+		printf( "SDL could not initialize! SDL Error: %s\n", SDL_GetError() );
+		success = false;
+	}
+	else
+	{
+		//Set texture filtering to linear
+		if( !SDL_SetHint( SDL_HINT_RENDER_SCALE_QUALITY, "1" ) )
+		{
+			printf( "Warning: Linear texture filtering not enabled!" );
+		}
+
+		//Create window
+		gWindow = SDL_CreateWindow( "SDL Tutorial", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN );
+		if( gWindow == NULL )
+		{
+			printf( "Window could not be created! SDL Error: %s\n", SDL_GetError() );
+			success = false;
+		}
+		else
+		{
+			//Create renderer for window
+			gRenderer = SDL_CreateRenderer( gWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC );
+			if( gRenderer == NULL )
+			{
+				printf( "Renderer could not be created! SDL Error: %s\n", SDL_GetError() );
+				success = false;
+			}
+			else
+			{
+				//Initialize renderer color
+				SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
+
+				//Initialize PNG loading
+				int imgFlags = IMG_INIT_PNG;
+				if( !( IMG_Init( imgFlags ) & imgFlags ) )
+				{
+					printf( "SDL_image could not initialize! SDL_image Error: %s\n", IMG_GetError() );
+					success = false;
+				}
+			}
+		}
+	}
+
+	return success;
+}
+
+bool loadMedia( TileMap& tiles )
+{
+	//Loading success flag
+	bool success = true;
+
+	//Load dot texture
+	if( !gDotTexture.loadFromFile( "Lesson_39/dot.bmp" ) )
+	{
+		printf( "Failed to load dot texture!\n" );
+		success = false;
+	}
+
+	//Load tile texture
+	if( !gTileTexture.loadFromFile( "Lesson_39/tiles.png" ) )
+	{
+		printf( "Failed to load tiles texture!\n" );
+		success = false;
+	}
+
+	//Load binary tile map, falling back to the text one
+	if( !tiles.loadFromFile( "Lesson_39/lazy.lmap" ) && !setTiles( tiles, "Lesson_39/lazy.map" ) )
+	{
+		printf( "Failde to load tile set!\n" );
+		success = false;
+	}
+
+	//Clip tile sprites
+	setTileClips();
+
+	return success;
+}
+
+bool checkCollision( SDL_Rect a, SDL_Rect b )
+{
+    //The sides of the rectangles
+    int leftA, leftB;
+    int rightA, rightB;
+    int topA, topB;
+    int bottomA, bottomB;
 
     //Calculate the sides of rect A
     leftA = a.x;
@@ -571,16 +1536,13 @@ bool checkCollision( SDL_Rect a, SDL_Rect b )
     return true;
 }
 
-bool setTiles( Tile* tiles[] )
+bool setTiles( TileMap& tiles, std::string path )
 {
 	//Success flag
 	bool tilesLoaded = true;
 
-	//The tile offsets
-	int x = 0, y = 0;
-
 	//Open the map
-	std::fstream map( "Lesson_39/lazy.map" );
+	std::fstream map( path.c_str() );
 
 	//If the map couldn't be loaded
 	if( map.fail() )
@@ -589,115 +1551,75 @@ bool setTiles( Tile* tiles[] )
 		tilesLoaded = false;
 	}
 	else 
-  {
-		//Initialize the tiles
-		for( int i = 0; i < TOTAL_TILES; ++ i )
+	{
+		//Read every row first, the level is as wide as the first row and as tall as the row count
+		std::vector< std::vector<int> > rows;
+		std::string line;
+		while( tilesLoaded && std::getline( map, line ) )
 		{
-			//Determinas what kind of tile will be made
+			std::istringstream values( line );
+			std::vector<int> row;
 			int tileType = -1;
+			while( values >> tileType )
+			{
+				row.push_back( tileType );
+			}
 
-			//Read tile from map file
-			map >> tileType;
-
-			//If there was a problem in reading the map
-		  if( map.fail() )
-		  {
-		  	//Stop loading map
-		  	printf( "Error loading map: Unexpected end of file!\n" );
-		  	tilesLoaded = false;
-		  	break;
-		  }
-			
-			//If the number is a valid tile number
-			if( ( tileType >= 0 ) && ( tileType < TOTAL_TILE_SPRITES ) )
+			//If there was a problem in reading the row
+			if( !values.eof() )
 			{
-				tiles[ i ] = new Tile( x, y, tileType );
+				printf( "Error loading map: Unreadable tile on row %d\n", (int)rows.size() );
+				tilesLoaded = false;
 			}
-			//If we don't recognize the tile type
-			else
+			//Skip blank lines
+			else if( row.empty() )
+			{
+				continue;
+			}
+			//If the row doesn't line up with the first
+			else if( !rows.empty() && row.size() != rows[ 0 ].size() )
 			{
-				//Stop loading the map
-				printf( "Error loading map: Invald tile type at %d\n", i);
+				printf( "Error loading map: Row %d has %d tiles instead of %d\n", (int)rows.size(), (int)row.size(), (int)rows[ 0 ].size() );
 				tilesLoaded = false;
-				break;
 			}
+			else
+			{
+				rows.push_back( row );
+			}
+		}
 
-		  //Move to next tile spot
-		  x += TILE_WIDTH;
-		  
-		  //If we've gone too far
-		  if( x >= LEVEL_WIDTH )
-		  {
-		  	//Move back
-		  	x = 0;
-
-		  	//Move to the next row
-		  	y += TILE_HEIGHT;
-		  }
+		if( tilesLoaded && rows.empty() )
+		{
+			printf( "Error loading map: No tiles!\n" );
+			tilesLoaded = false;
 		}
 
-		//Clip the sprite sheet
 		if( tilesLoaded )
 		{
-		  gTileClips[ TILE_RED ].x = 0;
-		  gTileClips[ TILE_RED ].y = 0;
-		  gTileClips[ TILE_RED ].w = TILE_WIDTH;
-		  gTileClips[ TILE_RED ].h = TILE_HEIGHT;
-
-		  gTileClips[ TILE_GREEN ].x = 0;
-		  gTileClips[ TILE_GREEN ].y = 80;
-		  gTileClips[ TILE_GREEN ].w = TILE_WIDTH;
-		  gTileClips[ TILE_GREEN ].h = TILE_HEIGHT;
-		  
-		  gTileClips[ TILE_BLUE ].x = 0;
-		  gTileClips[ TILE_BLUE ].y = 160;
-		  gTileClips[ TILE_BLUE ].w = TILE_WIDTH;
-		  gTileClips[ TILE_BLUE ].h = TILE_HEIGHT;
-		  
-		  gTileClips[ TILE_TOPLEFT ].x = 80;
-		  gTileClips[ TILE_TOPLEFT ].y = 0;
-		  gTileClips[ TILE_TOPLEFT ].w = TILE_WIDTH;
-		  gTileClips[ TILE_TOPLEFT ].h = TILE_HEIGHT;
-		  
-		  gTileClips[ TILE_LEFT ].x = 80;
-		  gTileClips[ TILE_LEFT ].y = 80;
-		  gTileClips[ TILE_LEFT ].w = TILE_WIDTH;
-		  gTileClips[ TILE_LEFT ].h = TILE_HEIGHT;
-
-		  gTileClips[ TILE_BOTTOMLEFT ].x = 80;
-		  gTileClips[ TILE_BOTTOMLEFT ].y = 160;
-		  gTileClips[ TILE_BOTTOMLEFT ].w = TILE_WIDTH;
-		  gTileClips[ TILE_BOTTOMLEFT ].h = TILE_HEIGHT;
-		  
-		  gTileClips[ TILE_TOP ].x = 160;
-		  gTileClips[ TILE_TOP ].y = 0;
-		  gTileClips[ TILE_TOP ].w = TILE_WIDTH;
-		  gTileClips[ TILE_TOP ].h = TILE_HEIGHT;
-		  
-		  gTileClips[ TILE_CENTER ].x = 160;
-		  gTileClips[ TILE_CENTER ].y = 80;
-		  gTileClips[ TILE_CENTER ].w = TILE_WIDTH;
-		  gTileClips[ TILE_CENTER ].h = TILE_HEIGHT;
-
-		  gTileClips[ TILE_BOTTOM ].x = 160;
-		  gTileClips[ TILE_BOTTOM ].y = 160;
-		  gTileClips[ TILE_BOTTOM ].w = TILE_WIDTH;
-		  gTileClips[ TILE_BOTTOM ].h = TILE_HEIGHT;
-		  
-		  gTileClips[ TILE_TOPRIGHT ].x = 240;
-		  gTileClips[ TILE_TOPRIGHT ].y = 0;
-		  gTileClips[ TILE_TOPRIGHT ].w = TILE_WIDTH;
-		  gTileClips[ TILE_TOPRIGHT ].h = TILE_HEIGHT;
-		  
-		  gTileClips[ TILE_RIGHT ].x = 240;
-		  gTileClips[ TILE_RIGHT ].y = 80;
-		  gTileClips[ TILE_RIGHT ].w = TILE_WIDTH;
-		  gTileClips[ TILE_RIGHT ].h = TILE_HEIGHT;
-
-		  gTileClips[ TILE_BOTTOMRIGHT ].x = 240;
-		  gTileClips[ TILE_BOTTOMRIGHT ].y = 160;
-		  gTileClips[ TILE_BOTTOMRIGHT ].w = TILE_WIDTH;
-		  gTileClips[ TILE_BOTTOMRIGHT ].h = TILE_HEIGHT;
+			//Size the level
+			tiles.create( (int)rows[ 0 ].size(), (int)rows.size() );
+
+			//Initialize the tiles
+			for( int y = 0; y < (int)rows.size() && tilesLoaded; ++y )
+			{
+				for( int x = 0; x < (int)rows[ y ].size(); ++x )
+				{
+					//If the number is a valid tile number
+					int tileType = rows[ y ][ x ];
+					if( ( tileType >= 0 ) && ( tileType < TOTAL_TILE_SPRITES ) )
+					{
+						tiles.setType( x, y, (Uint8)tileType );
+					}
+					//If we don't recognize the tile type
+					else
+					{
+						//Stop loading the map
+						printf( "Error loading map: Invald tile type at %d\n", y * (int)rows[ y ].size() + x );
+						tilesLoaded = false;
+						break;
+					}
+				}
+			}
 		}
 	}
 	
@@ -708,24 +1630,294 @@ bool setTiles( Tile* tiles[] )
 	return tilesLoaded;
 }
 
-bool touchesWall( SDL_Rect box, Tile* tiles[] )
+void setTileClips()
+{
+	//Clip the sprite sheet
+	gTileClips[ TILE_RED ].x = 0;
+	gTileClips[ TILE_RED ].y = 0;
+	gTileClips[ TILE_RED ].w = TILE_WIDTH;
+	gTileClips[ TILE_RED ].h = TILE_HEIGHT;
+
+	gTileClips[ TILE_GREEN ].x = 0;
+	gTileClips[ TILE_GREEN ].y = 80;
+	gTileClips[ TILE_GREEN ].w = TILE_WIDTH;
+	gTileClips[ TILE_GREEN ].h = TILE_HEIGHT;
+
+	gTileClips[ TILE_BLUE ].x = 0;
+	gTileClips[ TILE_BLUE ].y = 160;
+	gTileClips[ TILE_BLUE ].w = TILE_WIDTH;
+	gTileClips[ TILE_BLUE ].h = TILE_HEIGHT;
+
+	gTileClips[ TILE_TOPLEFT ].x = 80;
+	gTileClips[ TILE_TOPLEFT ].y = 0;
+	gTileClips[ TILE_TOPLEFT ].w = TILE_WIDTH;
+	gTileClips[ TILE_TOPLEFT ].h = TILE_HEIGHT;
+
+	gTileClips[ TILE_LEFT ].x = 80;
+	gTileClips[ TILE_LEFT ].y = 80;
+	gTileClips[ TILE_LEFT ].w = TILE_WIDTH;
+	gTileClips[ TILE_LEFT ].h = TILE_HEIGHT;
+
+	gTileClips[ TILE_BOTTOMLEFT ].x = 80;
+	gTileClips[ TILE_BOTTOMLEFT ].y = 160;
+	gTileClips[ TILE_BOTTOMLEFT ].w = TILE_WIDTH;
+	gTileClips[ TILE_BOTTOMLEFT ].h = TILE_HEIGHT;
+
+	gTileClips[ TILE_TOP ].x = 160;
+	gTileClips[ TILE_TOP ].y = 0;
+	gTileClips[ TILE_TOP ].w = TILE_WIDTH;
+	gTileClips[ TILE_TOP ].h = TILE_HEIGHT;
+
+	gTileClips[ TILE_CENTER ].x = 160;
+	gTileClips[ TILE_CENTER ].y = 80;
+	gTileClips[ TILE_CENTER ].w = TILE_WIDTH;
+	gTileClips[ TILE_CENTER ].h = TILE_HEIGHT;
+
+	gTileClips[ TILE_BOTTOM ].x = 160;
+	gTileClips[ TILE_BOTTOM ].y = 160;
+	gTileClips[ TILE_BOTTOM ].w = TILE_WIDTH;
+	gTileClips[ TILE_BOTTOM ].h = TILE_HEIGHT;
+
+	gTileClips[ TILE_TOPRIGHT ].x = 240;
+	gTileClips[ TILE_TOPRIGHT ].y = 0;
+	gTileClips[ TILE_TOPRIGHT ].w = TILE_WIDTH;
+	gTileClips[ TILE_TOPRIGHT ].h = TILE_HEIGHT;
+
+	gTileClips[ TILE_RIGHT ].x = 240;
+	gTileClips[ TILE_RIGHT ].y = 80;
+	gTileClips[ TILE_RIGHT ].w = TILE_WIDTH;
+	gTileClips[ TILE_RIGHT ].h = TILE_HEIGHT;
+
+	gTileClips[ TILE_BOTTOMRIGHT ].x = 240;
+	gTileClips[ TILE_BOTTOMRIGHT ].y = 160;
+	gTileClips[ TILE_BOTTOMRIGHT ].w = TILE_WIDTH;
+	gTileClips[ TILE_BOTTOMRIGHT ].h = TILE_HEIGHT;
+}
+
+Uint32 readUint32( const Uint8* bytes )
+{
+	return (Uint32)bytes[ 0 ] | ( (Uint32)bytes[ 1 ] << 8 ) | ( (Uint32)bytes[ 2 ] << 16 ) | ( (Uint32)bytes[ 3 ] << 24 );
+}
+
+void writeUint32( std::vector<Uint8>& bytes, Uint32 value )
 {
-	//Go through the tiles
-  for( int i = 0; i < TOTAL_TILES; ++i )
-  {
-  	//If the tile is a wall type tile
-  	if( ( tiles[ i ]->getType() >= TILE_CENTER ) && ( tiles[ i ]->getType() <= TILE_TOPLEFT ) )
-  	{
-  		//If the collision box touches the wall tile
-  		if( checkCollision( box, tiles[ i ]->getBox() ) )
+	bytes.push_back( (Uint8)value );
+	bytes.push_back( (Uint8)( value >> 8 ) );
+	bytes.push_back( (Uint8)( value >> 16 ) );
+	bytes.push_back( (Uint8)( value >> 24 ) );
+}
+
+void getCoveredTiles( SDL_Rect box, int columns, int rows, int& firstColumn, int& firstRow, int& lastColumn, int& lastRow )
+{
+	//Right and bottom edges are exclusive like in checkCollision
+	firstColumn = std::max( box.x, 0 ) / TILE_WIDTH;
+	firstRow = std::max( box.y, 0 ) / TILE_HEIGHT;
+	lastColumn = std::min( ( box.x + box.w - 1 ) / TILE_WIDTH, columns - 1 );
+	lastRow = std::min( ( box.y + box.h - 1 ) / TILE_HEIGHT, rows - 1 );
+}
+
+bool sweepAxis( int start, int size, float velocity, int targetStart, int targetSize, float& entry, float& exit )
+{
+	//Not moving on this axis, so it either always or never overlaps
+	if( velocity == 0.f )
+	{
+		if( start + size <= targetStart || start >= targetStart + targetSize )
+		{
+			return false;
+		}
+		entry = -INFINITY;
+		exit = INFINITY;
+	}
+	else if( velocity > 0.f )
+	{
+		entry = ( targetStart - ( start + size ) ) / velocity;
+		exit = ( targetStart + targetSize - start ) / velocity;
+	}
+	else
+	{
+		entry = ( targetStart + targetSize - start ) / velocity;
+		exit = ( targetStart - ( start + size ) ) / velocity;
+	}
+
+	return true;
+}
+
+SweepHit sweepBox( SDL_Rect box, float velX, float velY, SDL_Rect target )
+{
+	SweepHit hit = { 1.f, 0, 0 };
+
+	//When the box overlaps the target on each axis
+	float entryX, exitX, entryY, exitY;
+	if( !sweepAxis( box.x, box.w, velX, target.x, target.w, entryX, exitX ) || !sweepAxis( box.y, box.h, velY, target.y, target.h, entryY, exitY ) )
+	{
+		return hit;
+	}
+
+	//The boxes overlap once both axes do, until either stops
+	float entry = std::max( entryX, entryY );
+	float exit = std::min( exitX, exitY );
+
+	//Skip targets that are only grazed, already overlapped, or out of reach this move
+	if( entry >= exit || entry < 0.f || entry >= 1.f )
+	{
+		return hit;
+	}
+
+	//The axis that started overlapping last is the one that got blocked
+	hit.time = entry;
+	if( entryX > entryY )
+	{
+		hit.normalX = velX > 0.f ? -1 : 1;
+	}
+	else
+	{
+		hit.normalY = velY > 0.f ? -1 : 1;
+	}
+
+	return hit;
+}
+
+SweepHit sweepTiles( SDL_Rect box, float velX, float velY, TileMap& tiles )
+{
+	SweepHit hit = { 1.f, 0, 0 };
+
+	//Everything the box passes over
+	SDL_Rect area = box;
+	area.x += (int)std::floor( std::min( velX, 0.f ) );
+	area.y += (int)std::floor( std::min( velY, 0.f ) );
+	area.w += (int)std::ceil( std::fabs( velX ) );
+	area.h += (int)std::ceil( std::fabs( velY ) );
+
+	//Keep the earliest wall tile contact
+	int firstColumn, firstRow, lastColumn, lastRow;
+	getCoveredTiles( area, tiles.getColumns(), tiles.getRows(), firstColumn, firstRow, lastColumn, lastRow );
+	for( int row = firstRow; row <= lastRow; ++row )
+	{
+		for( int column = firstColumn; column <= lastColumn; ++column )
+		{
+			Uint8 type = tiles.getType( column, row );
+			if( ( type >= TILE_CENTER ) && ( type <= TILE_TOPLEFT ) )
+			{
+				SweepHit tileHit = sweepBox( box, velX, velY, tiles.getBox( column, row ) );
+				if( tileHit.time < hit.time )
+				{
+					hit = tileHit;
+				}
+			}
+		}
+	}
+
+	//The level edges are walls too, overlapping at the corners so nothing slips out diagonally
+	int width = tiles.getColumns() * TILE_WIDTH;
+	int height = tiles.getRows() * TILE_HEIGHT;
+	SDL_Rect edges[ 4 ] =
+	{
+		{ -TILE_WIDTH, -TILE_HEIGHT, TILE_WIDTH, height + 2 * TILE_HEIGHT },
+		{ width, -TILE_HEIGHT, TILE_WIDTH, height + 2 * TILE_HEIGHT },
+		{ -TILE_WIDTH, -TILE_HEIGHT, width + 2 * TILE_WIDTH, TILE_HEIGHT },
+		{ -TILE_WIDTH, height, width + 2 * TILE_WIDTH, TILE_HEIGHT }
+	};
+	for( int edge = 0; edge < 4; ++edge )
+	{
+		SweepHit edgeHit = sweepBox( box, velX, velY, edges[ edge ] );
+		if( edgeHit.time < hit.time )
+		{
+			hit = edgeHit;
+		}
+	}
+
+	return hit;
+}
+
+void renderTiles( TileMap& tiles, SDL_Rect& camera )
+{
+	//Grid cells on screen
+	int firstColumn, firstRow, lastColumn, lastRow;
+	getCoveredTiles( camera, tiles.getColumns(), tiles.getRows(), firstColumn, firstRow, lastColumn, lastRow );
+
+	//Show only those tiles
+	for( int row = firstRow; row <= lastRow; ++row )
+	{
+		for( int column = firstColumn; column <= lastColumn; ++column )
+		{
+			//Skip tiles whose chunk isn't loaded
+			Uint8 type = tiles.getType( column, row );
+			if( type != TILE_NONE )
+			{
+				gSpriteBatch.render( &gTileTexture, column * TILE_WIDTH - camera.x, row * TILE_HEIGHT - camera.y, &gTileClips[ type ] );
+			}
+		}
+	}
+}
+
+void benchmarkTileCulling()
+{
+	//Synthetic level far bigger than the screen
+	TileMap tiles;
+	tiles.create( 1000, 1000 );
+	for( int row = 0; row < tiles.getRows(); ++row )
+	{
+		for( int column = 0; column < tiles.getColumns(); ++column )
+		{
+			tiles.setType( column, row, (Uint8)( ( row + column ) % TOTAL_TILE_SPRITES ) );
+		}
+	}
+
+	//Pan the camera diagonally across the level
+	const int frames = 200;
+	SDL_Rect camera = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
+	int stepX = ( tiles.getColumns() * TILE_WIDTH - SCREEN_WIDTH ) / frames;
+	int stepY = ( tiles.getRows() * TILE_HEIGHT - SCREEN_HEIGHT ) / frames;
+
+	//Test every tile against the camera
+	int scannedVisible = 0;
+	Uint64 start = SDL_GetPerformanceCounter();
+	for( int frame = 0; frame < frames; ++frame )
+	{
+		camera.x = frame * stepX;
+		camera.y = frame * stepY;
+		for( int row = 0; row < tiles.getRows(); ++row )
+		{
+			for( int column = 0; column < tiles.getColumns(); ++column )
 			{
-				return true;
+				if( checkCollision( camera, tiles.getBox( column, row ) ) && tiles.getType( column, row ) != TILE_NONE )
+				{
+					scannedVisible++;
+				}
 			}
-  	}
-  }
+		}
+	}
+	Uint64 scanTicks = SDL_GetPerformanceCounter() - start;
 
-  //If no wall tiles were touched
-	return false;
+	//Visit only the tiles in the camera's cell range
+	int culledVisible = 0;
+	start = SDL_GetPerformanceCounter();
+	for( int frame = 0; frame < frames; ++frame )
+	{
+		camera.x = frame * stepX;
+		camera.y = frame * stepY;
+
+		int firstColumn, firstRow, lastColumn, lastRow;
+		getCoveredTiles( camera, tiles.getColumns(), tiles.getRows(), firstColumn, firstRow, lastColumn, lastRow );
+		for( int row = firstRow; row <= lastRow; ++row )
+		{
+			for( int column = firstColumn; column <= lastColumn; ++column )
+			{
+				//Read the tile like rendering would
+				if( tiles.getType( column, row ) != TILE_NONE )
+				{
+					culledVisible++;
+				}
+			}
+		}
+	}
+	Uint64 cullTicks = SDL_GetPerformanceCounter() - start;
+
+	//Report time per frame
+	double frequency = (double)SDL_GetPerformanceFrequency();
+	printf( "%d x %d tiles, %d frames\n", tiles.getColumns(), tiles.getRows(), frames );
+	printf( "full scan: %10.3f ms per frame, %d tiles visible\n", scanTicks * 1000.0 / frequency / frames, scannedVisible / frames );
+	printf( "culled:    %10.3f ms per frame, %d tiles visible\n", cullTicks * 1000.0 / frequency / frames, culledVisible / frames );
 }
 
 void close()
@@ -733,6 +1925,7 @@ void close()
 	//Free loaded images
 	gDotTexture.free();
 	gTileTexture.free();
+	gTileCache.free();
 	
 	//Destroy window	
 	SDL_DestroyRenderer( gRenderer );
@@ -747,6 +1940,25 @@ void close()
 
 int main( int argc, char* args[] )
 {
+	//Time tile culling instead of running the demo
+	if( argc > 1 && std::string( args[ 1 ] ) == "--benchmark" )
+	{
+		benchmarkTileCulling();
+		return 0;
+	}
+
+	//Convert a text map to a binary one instead of running the demo
+	if( argc > 3 && std::string( args[ 1 ] ) == "--convert" )
+	{
+		TileMap tiles;
+		if( !setTiles( tiles, args[ 2 ] ) || !tiles.saveToFile( args[ 3 ] ) )
+		{
+			printf( "Failed to convert %s!\n", args[ 2 ] );
+			return 1;
+		}
+		return 0;
+	}
+
 	//Start up SDL and create window
 	if( !init() )
 	{
@@ -755,7 +1967,7 @@ int main( int argc, char* args[] )
 	else
 	{
 		//The level tiles
-		Tile* tileSet[ TOTAL_TILES ];
+		TileMap tileSet;
 
 		//Load media
 		if( !loadMedia( tileSet ) )
@@ -787,28 +1999,41 @@ int main( int argc, char* args[] )
 					{
 						quit = true;
 					}
+					//The renderer lost what was drawn into the cached blocks
+					else if( e.type == SDL_RENDER_TARGETS_RESET )
+					{
+						gTileCache.invalidate();
+					}
+					//The renderer lost the block textures themselves
+					else if( e.type == SDL_RENDER_DEVICE_RESET )
+					{
+						gTileCache.free();
+					}
 
 					//Handle input for the dot
 					dot.handleEvent( e );
 				}
 
+				//Keep the level around the camera in memory
+				tileSet.streamChunks( camera );
+
 				//Move the dot
 				dot.move( tileSet );
-				dot.setCamera( camera );
+				dot.setCamera( camera, tileSet );
 
 				//Clear screen
 				SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
 				SDL_RenderClear( gRenderer );
 
-        //Render level
-        for( int i = 0; i < TOTAL_TILES; ++i )
-        {
-        	tileSet[ i]->render( camera );
-        }
+				//Render visible part of the level from the pre-rendered blocks
+				gTileCache.render( tileSet, camera );
 
 				//Render objects
 				dot.render( camera );
 
+				//Draw the queued sprites
+				gSpriteBatch.flush();
+
 				//Update screen
 				SDL_RenderPresent( gRenderer );
 			}
@@ -1,13 +1,22 @@
-//Using SDL, SDL_image, standard IO, and strings
+//Using SDL, SDL_image, standard IO, strings, and vectors
 #include <SDL.h>
 #include <SDL_image.h>
 #include <stdio.h>
 #include <string>
+#include <vector>
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+//Bitmap font metrics cache identification
+const Sint32 FONT_METRICS_MAGIC = 0x4D464C42;
+const Sint32 FONT_METRICS_VERSION = 1;
+
+//Header fields and values per character in the metrics cache
+const int FONT_METRICS_HEADER_SIZE = 7;
+const int FONT_METRICS_CHAR_SIZE = 4;
+
 //Texture wrapper class
 class LTexture
 {
@@ -56,6 +65,9 @@ class LTexture
 		Uint32 getPixel32( Uint32 x, Uint32 y );
 		Uint32 getPitch32();
 
+		//Gets the hardware texture
+		SDL_Texture* getTexture();
+
 	private:
 		//The actual hardware texture
 		SDL_Texture* mTexture;
@@ -81,13 +93,32 @@ class LBitmapFont
   	//Deallocates font
   	void free();
 
-  	//Shows the text
+  	//Shows the text with one draw call
   	void renderText( int x, int y, std::string text );
 
   private:
+  	//Finds the character boxes and spacing from the font pixels
+  	void measureCells();
+
+  	//Reads metrics cached for the same font pixels
+  	bool loadMetrics( std::string path, Uint32 checksum );
+
+  	//Caches metrics next to the font
+  	bool saveMetrics( std::string path, Uint32 checksum );
+
+  	//Hashes the font pixels so stale caches are noticed
+  	Uint32 getPixelChecksum();
+
+  	//Queues a character quad
+  	void queueChar( SDL_Rect& clip, int x, int y );
+
   	//The font texture
   	LTexture mFontTexture;
 
+  	//Quads of the text being drawn
+  	std::vector<SDL_Vertex> mVertices;
+  	std::vector<int> mIndices;
+
   	//The individual characters in the surface
   	SDL_Rect mChars[ 256 ];
 
@@ -350,6 +381,11 @@ Uint32 LTexture::getPitch32()
 	return pitch;
 }
 
+SDL_Texture* LTexture::getTexture()
+{
+	return mTexture;
+}
+
 LBitmapFont::LBitmapFont()
 {
 	//Initialize variables
@@ -371,171 +407,280 @@ bool LBitmapFont::buildFont( std::string path )
 	}
 	else
 	{
-		// Get the background color
-		Uint32 bgColor = mFontTexture.getPixel32( 0, 0);
+		//Reuse the metrics if the font hasn't changed since they were cached
+		std::string metricsPath = path + ".metrics";
+		Uint32 checksum = getPixelChecksum();
+		if( !loadMetrics( metricsPath, checksum ) )
+		{
+			//Scan the font and cache what was found
+			measureCells();
+			saveMetrics( metricsPath, checksum );
+		}
 
-		//Set the cell dimensions
-		int cellW = mFontTexture.getWidth() / 16;
-		int cellH = mFontTexture.getHeight() / 16;
+		//Create final texture
+		if( !mFontTexture.loadFromPixels() ) 
+		{
+			printf("Unable to create font texture!\n");
+			success = false;
+		}
 
-		//New line variables
-		int top = cellH;
-		int baseA = cellH;
+	}
+
+	return success;
+}
+
+void LBitmapFont::measureCells()
+{
+	//Get the pixels and the background color
+	Uint32* pixels = mFontTexture.getPixels32();
+	Uint32 pitch = mFontTexture.getPitch32();
+	Uint32 bgColor = pixels[ 0 ];
 
-		//The current character we're setting
-		int currentChar = 0;
+	//Set the cell dimensions
+	int cellW = mFontTexture.getWidth() / 16;
+	int cellH = mFontTexture.getHeight() / 16;
 
-		//Go through the cell rows
-		for( int rows = 0; rows < 16; ++ rows )
+	//New line variables
+	int top = cellH;
+	int baseA = cellH;
+
+	//The current character we're setting
+	int currentChar = 0;
+
+	//Go through the cell rows
+	for( int rows = 0; rows < 16; ++ rows )
+	{
+		//Go through the cell columns
+		for( int cols = 0; cols < 16; ++ cols)
 		{
-			//Go through the cell columns
-			for( int cols = 0; cols < 16; ++ cols)
+			//Ink bounds within the cell
+			int left = cellW;
+			int right = -1;
+			int firstRow = -1;
+			int lastRow = -1;
+
+			//Go through the pixel rows once
+			for( int pRow = 0; pRow < cellH; ++pRow )
 			{
-				//Set the character offset
-				mChars[ currentChar ].x = cellW * cols;
-				mChars[ currentChar ].y = cellH * rows;
-
-				//Set the dimention of the character
-				mChars[ currentChar ].w = cellW;
-				mChars[ currentChar ].h = cellH;
-	    	
-	    	//Find Left Side
-	    	for( int pCol = 0; pCol < cellW; ++pCol )
-	    	{
-	    		//Go through pixel rows
-	    		for( int pRow = 0; pRow < cellH; ++pRow )
-	    		{
-	    			//Get the pixel offsets
-	    			int pX = ( cellW * cols ) + pCol;
-	    			int pY = ( cellH * rows ) + pRow;
-
-	    			//If a non colorkey pixel is found
-	    			if( mFontTexture.getPixel32( pX, pY ) != bgColor )
-	    			{
-	    				//Set the x offset
-	    				mChars[ currentChar ].x = pX;
-
-	    				//Breake the loops
-	    				pCol = cellW;
-	    				pRow = cellH;
-	    			}
-	    		}
-	    	}
-
-				//Find Right Side
-				//Go through pixel columns
-				for( int pColW = cellW - 1; pColW >= 0; --pColW) 
+				Uint32* row = pixels + ( cellH * rows + pRow ) * pitch + cellW * cols;
+
+				//Find the leftmost non colorkey pixel in the row
+				int pCol = 0;
+				while( pCol < cellW && row[ pCol ] == bgColor )
 				{
-					//Go through pixel rows
-					for( int pRowW = 0; pRowW < cellH; ++pRowW )
-					{
-						//Get the pixel offsets
-						int pX = ( cellW * cols ) + pColW;
-						int pY = ( cellH * rows ) + pRowW;
-
-						//If a non colorkey pixel is found
-						if ( mFontTexture.getPixel32( pX, pY ) != bgColor )
-						{
-							//Set the width
-							mChars[ currentChar ].w = ( pX -mChars[ currentChar ].x ) + 1;
-
-							//Break the loop
-							pColW = -1;
-							pRowW = cellH;
-						}
-					}
+					++pCol;
 				}
 
-				//Find Top
-				//Go through pixel rows
-				for( int pRow = 0; pRow < cellW; ++pRow )
+				//Skip empty rows
+				if( pCol == cellW )
 				{
-					//Go through pixel columns
-					for ( int pCol = 0; pCol < cellW; ++pCol )
-					{
-						//Get the pixel offsets
-						int pX = ( cellW * cols ) + pCol;
-						int pY = ( cellH * rows ) + pRow;
-
-						//If a non colorkey pixel is found
-						if( mFontTexture.getPixel32( pX, pY ) != bgColor )
-						{
-							//If new top is found
-							if( pRow < top )
-							{
-								top = pRow;
-							}
-
-							//Break the loop
-							pCol = cellW;
-							pRow = cellH;
-						}
-					}
+					continue;
+				}
+
+				//Grow the vertical bounds
+				if( firstRow < 0 )
+				{
+					firstRow = pRow;
 				}
+				lastRow = pRow;
 
-				//Find Bottom of A
-				if( currentChar == 'A' )
+				//Grow the left side
+				if( pCol < left )
 				{
-					//Go through pixel rows
-					for( int pRow = cellH - 1; pRow >= 0; --pRow )
+					left = pCol;
+				}
+
+				//Grow the right side, only checking past what's already known
+				for( int pColW = cellW - 1; pColW > right && pColW >= pCol; --pColW )
+				{
+					if( row[ pColW ] != bgColor )
 					{
-						//Go through pixel columns
-				  	for( int pCol = 0; pCol < cellW; ++pCol)
-				  	{
-				  		//Get the pixel offsets
-				  		int pX = ( cellW * cols ) + pCol;
-				  		int pY = ( cellH * rows ) + pRow;
-
-				  		//If a non colorkey pixel is found
-				  		if( mFontTexture.getPixel32( pX, pY ) != bgColor )
-				  		{
-				  			//Bottom of A is found
-				  			baseA = pRow;
-
-				  			//Break the loop
-				  			pCol = cellW;;
-				  			pRow = -1;
-				  		}
-				  	}
+						right = pColW;
 					}
 				}
+			}
+
+			//Set the character box, keeping the whole cell if it's blank
+			mChars[ currentChar ].x = cellW * cols;
+			mChars[ currentChar ].y = cellH * rows;
+			mChars[ currentChar ].w = cellW;
+			mChars[ currentChar ].h = cellH;
+			if( right >= 0 )
+			{
+				mChars[ currentChar ].x += left;
+				mChars[ currentChar ].w = right - left + 1;
+			}
+
+			//If new top is found
+			if( firstRow >= 0 && firstRow < top )
+			{
+				top = firstRow;
+			}
 
-				// Go to the next character
-				++currentChar;
+			//Bottom of A is found
+			if( currentChar == 'A' && lastRow >= 0 )
+			{
+				baseA = lastRow;
 			}
+
+			// Go to the next character
+			++currentChar;
 		}
+	}
 
-		//Calculate space
-		mSpace = cellW / 2;
+	//Calculate space
+	mSpace = cellW / 2;
 
+	//Calculate new line
+	mNewLine = baseA - top;
 
-		//Calculate new line
-		mNewLine = baseA - top;
+	//Lop off excess top pixels
+	for( int i = 0; i < 256; ++i )
+	{
+		mChars[ i ].y += top;
+		mChars[ i ].h -= top;
+	}
+}
 
-		//Lop off excess top pixels
-		for( int i = 0; i < 256; ++i )
-		{
-			mChars[ i ].y += top;
-			mChars[ i ].h += top;
-		}
+bool LBitmapFont::loadMetrics( std::string path, Uint32 checksum )
+{
+	//No cache yet
+	SDL_RWops* file = SDL_RWFromFile( path.c_str(), "rb" );
+	if( file == NULL )
+	{
+		return false;
+	}
 
-		//Create final texture
-		if( !mFontTexture.loadFromPixels() ) 
-		{
-			printf("Unable to create font texture!\n");
-			success = false;
-		}
+	//Read everything at once
+	std::vector<Sint32> data( FONT_METRICS_HEADER_SIZE + 256 * FONT_METRICS_CHAR_SIZE );
+	bool success = SDL_RWread( file, &data[ 0 ], data.size() * sizeof( Sint32 ), 1 ) == 1;
+	SDL_RWclose( file );
+
+	//Only use metrics made from these exact pixels
+	if( !success || data[ 0 ] != FONT_METRICS_MAGIC || data[ 1 ] != FONT_METRICS_VERSION ||
+		data[ 2 ] != mFontTexture.getWidth() || data[ 3 ] != mFontTexture.getHeight() || (Uint32)data[ 4 ] != checksum )
+	{
+		printf( "Rebuilding stale font metrics %s\n", path.c_str() );
+		return false;
+	}
+
+	//Get the spacing and character boxes
+	mNewLine = data[ 5 ];
+	mSpace = data[ 6 ];
+	for( int i = 0; i < 256; ++i )
+	{
+		Sint32* values = &data[ FONT_METRICS_HEADER_SIZE + i * FONT_METRICS_CHAR_SIZE ];
+		mChars[ i ].x = values[ 0 ];
+		mChars[ i ].y = values[ 1 ];
+		mChars[ i ].w = values[ 2 ];
+		mChars[ i ].h = values[ 3 ];
+	}
+
+	return true;
+}
+
+bool LBitmapFont::saveMetrics( std::string path, Uint32 checksum )
+{
+	//Header then character boxes
+	std::vector<Sint32> data;
+	data.push_back( FONT_METRICS_MAGIC );
+	data.push_back( FONT_METRICS_VERSION );
+	data.push_back( mFontTexture.getWidth() );
+	data.push_back( mFontTexture.getHeight() );
+	data.push_back( (Sint32)checksum );
+	data.push_back( mNewLine );
+	data.push_back( mSpace );
+	for( int i = 0; i < 256; ++i )
+	{
+		data.push_back( mChars[ i ].x );
+		data.push_back( mChars[ i ].y );
+		data.push_back( mChars[ i ].w );
+		data.push_back( mChars[ i ].h );
+	}
 
+	//Open file for writing in binary
+	SDL_RWops* file = SDL_RWFromFile( path.c_str(), "w+b" );
+	if( file == NULL )
+	{
+		printf( "Warning: Unable to cache font metrics! SDL Error: %s\n", SDL_GetError() );
+		return false;
+	}
+
+	//Write everything at once
+	bool success = SDL_RWwrite( file, &data[ 0 ], data.size() * sizeof( Sint32 ), 1 ) == 1;
+	if( !success )
+	{
+		printf( "Warning: Unable to write font metrics! SDL Error: %s\n", SDL_GetError() );
 	}
+	SDL_RWclose( file );
 
 	return success;
 }
 
+Uint32 LBitmapFont::getPixelChecksum()
+{
+	Uint32* pixels = mFontTexture.getPixels32();
+	Uint32 pitch = mFontTexture.getPitch32();
+
+	//FNV-1a over every pixel, skipping row padding
+	Uint32 hash = 2166136261u;
+	for( int y = 0; y < mFontTexture.getHeight(); ++y )
+	{
+		for( int x = 0; x < mFontTexture.getWidth(); ++x )
+		{
+			hash = ( hash ^ pixels[ y * pitch + x ] ) * 16777619u;
+		}
+	}
+
+	return hash;
+}
+
 void LBitmapFont::free()
 {
 	mFontTexture.free();
 }
 
+void LBitmapFont::queueChar( SDL_Rect& clip, int x, int y )
+{
+	//Texture coordinates of the character
+	float textureW = (float)mFontTexture.getWidth();
+	float textureH = (float)mFontTexture.getHeight();
+	float u0 = clip.x / textureW;
+	float v0 = clip.y / textureH;
+	float u1 = ( clip.x + clip.w ) / textureW;
+	float v1 = ( clip.y + clip.h ) / textureH;
+
+	//Quad corners clockwise from the top left
+	float cornersX[ 4 ] = { 0.f, (float)clip.w, (float)clip.w, 0.f };
+	float cornersY[ 4 ] = { 0.f, 0.f, (float)clip.h, (float)clip.h };
+	float cornersU[ 4 ] = { u0, u1, u1, u0 };
+	float cornersV[ 4 ] = { v0, v0, v1, v1 };
+
+	//Queue the corners
+	int first = (int)mVertices.size();
+	for( int i = 0; i < 4; ++i )
+	{
+		SDL_Vertex vertex;
+		vertex.position.x = x + cornersX[ i ];
+		vertex.position.y = y + cornersY[ i ];
+		vertex.color.r = 0xFF;
+		vertex.color.g = 0xFF;
+		vertex.color.b = 0xFF;
+		vertex.color.a = 0xFF;
+		vertex.tex_coord.x = cornersU[ i ];
+		vertex.tex_coord.y = cornersV[ i ];
+		mVertices.push_back( vertex );
+	}
+
+	//Two triangles per quad
+	mIndices.push_back( first );
+	mIndices.push_back( first + 1 );
+	mIndices.push_back( first + 2 );
+	mIndices.push_back( first + 2 );
+	mIndices.push_back( first + 3 );
+	mIndices.push_back( first );
+}
+
 void LBitmapFont::renderText( int x, int y, std::string text )
 {
 	//If the font has been built
@@ -544,6 +689,10 @@ void LBitmapFont::renderText( int x, int y, std::string text )
 		// Temp offsets
 		int curX = x, curY = y;
 
+		//Keep the storage from the last call
+		mVertices.clear();
+		mIndices.clear();
+
 		//Go through the text
 		for( int i = 0; i < text.length(); ++i )
 		{
@@ -568,13 +717,22 @@ void LBitmapFont::renderText( int x, int y, std::string text )
 				//Get the ASCII value of the character
 				int ascii = (unsigned char)text[ i ];
 
-				//Show the character
-				mFontTexture.render( curX, curY, &mChars[ ascii ] );
+				//Queue the character
+				queueChar( mChars[ ascii ], curX, curY );
 
 				//Move over the width of the charactor with one pixel of padding
 				curX += mChars[ ascii ].w + 1;
 			}
 		}
+
+		//Show all the characters at once
+		if( !mIndices.empty() )
+		{
+			if( SDL_RenderGeometry( gRenderer, mFontTexture.getTexture(), &mVertices[ 0 ], (int)mVertices.size(), &mIndices[ 0 ], (int)mIndices.size() ) < 0 )
+			{
+				printf( "Unable to render text! SDL Error: %s\n", SDL_GetError() );
+			}
+		}
 	}
 }
 bool init()
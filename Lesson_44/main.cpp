@@ -8,6 +8,12 @@
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+//Simulation runs at a fixed rate whatever the display does
+const int SIMULATION_TICKS_PER_SECOND = 60;
+
+//Most ticks simulated in one frame before the rest are dropped
+const int MAX_TICKS_PER_FRAME = 5;
+
 //Texture wrapper class
 class LTexture
 {
@@ -94,25 +100,92 @@ class LTimer
     void pause();
     void unpause();
 
-    //Gets the timer's time
+    //Gets the timer's time in milliseconds
     Uint32 getTicks();
 
+    //Gets the timer's time in finer units
+    Uint64 getMicroseconds();
+    Uint64 getNanoseconds();
+
     //Checks the status of the timer
     bool isStarted();
     bool isPaused();
 
   private:
-    //The clock time when the timer starts
-    Uint32 mStartTicks;
+    //Gets the timer's time in performance counter units
+    Uint64 getCounts();
 
-    //The ticks stored when the timer was paused
-    Uint32 mPausedTicks;
+    //Converts the timer's time to units per second
+    Uint64 getTime( Uint64 unitsPerSecond );
+
+    //The performance counter when the timer started
+    Uint64 mStartCounts;
+
+    //The counts stored when the timer was paused
+    Uint64 mPausedCounts;
 
     //The timer status
     bool mPaused;
     bool mStarted;
 };
 
+//Runs the simulation in fixed ticks and tells rendering how far it is into the next one
+class LFixedStepLoop
+{
+  public:
+    //Initializes variables
+    LFixedStepLoop( int ticksPerSecond, int maxTicksPerFrame );
+
+    //Starts timing frames
+    void start();
+
+    //Adds the time since the last frame and gets how many ticks to simulate
+    int beginFrame();
+
+    //Marks the end of the frame's ticks
+    void endSimulation();
+
+    //Marks the end of drawing, before presenting
+    void endRendering();
+
+    //Gets the length of a tick in seconds
+    float getTickSeconds();
+
+    //Gets how far the current time is between the last two simulated states, 0 to 1
+    float getAlpha();
+
+    //Sets how long drawing a frame may take
+    void setRenderBudget( float milliseconds );
+
+    //Gets budget overrun counts
+    int getDroppedTicks();
+    int getSimulationOverruns();
+    int getRenderOverruns();
+
+  private:
+    //Tick length
+    float mTickLength;
+    int mMaxTicksPerFrame;
+
+    //Time not yet simulated
+    float mAccumulator;
+
+    //Ticks simulated this frame
+    int mFrameTicks;
+
+    //Time since the last frame and time spent in this one
+    LTimer mFrameTimer;
+    LTimer mWorkTimer;
+
+    //Allowed drawing time
+    float mRenderBudget;
+
+    //Ticks thrown away to catch up, frames whose ticks took longer than the time they cover, and frames that drew too slowly
+    int mDroppedTicks;
+    int mSimulationOverruns;
+    int mRenderOverruns;
+};
+
 //The dot that will move around on the screen
 class Dot
 {
@@ -133,12 +206,15 @@ class Dot
         //Moves the dot
         void move( float timeStep );
 
-		//Shows the dot on the screen
-		void render();
+		//Shows the dot between its last two positions
+		void render( float alpha );
 
 	private:
 		float mPosX, mPosY;
 		float mVelX, mVelY;
+
+		//Position before the last move
+		float mPrevPosX, mPrevPosY;
 };
 
 //Starts up SDL and creates window
@@ -479,8 +555,8 @@ void LTexture::copyRawPixels32( void* pixels )
 LTimer::LTimer()
 {
   //Initialize the variables
-  mStartTicks = 0;
-  mPausedTicks = 0;
+  mStartCounts = 0;
+  mPausedCounts = 0;
 
   mPaused = false;
   mStarted = false;
@@ -495,8 +571,8 @@ void LTimer::start()
   mPaused = false;
 
   //Get the current clock time
-  mStartTicks = SDL_GetTicks();
-  mPausedTicks = 0;
+  mStartCounts = SDL_GetPerformanceCounter();
+  mPausedCounts = 0;
 }
 
 void LTimer::stop()
@@ -508,8 +584,8 @@ void LTimer::stop()
   mPaused = false;
 
   //Clear tick variables
-  mStartTicks = 0;
-  mPausedTicks = 0;
+  mStartCounts = 0;
+  mPausedCounts = 0;
 }
 
 void LTimer::pause()
@@ -521,8 +597,8 @@ void LTimer::pause()
     mPaused = true;
 
     //Calculate the paused ticks
-    mPausedTicks = SDL_GetTicks() - mStartTicks;
-    mStartTicks = 0;
+    mPausedCounts = SDL_GetPerformanceCounter() - mStartCounts;
+    mStartCounts = 0;
   }
 }
 
@@ -535,17 +611,17 @@ void LTimer::unpause()
     mPaused = false;
 
     //Reset the starting ticks
-    mStartTicks = SDL_GetTicks() - mPausedTicks;
+    mStartCounts = SDL_GetPerformanceCounter() - mPausedCounts;
 
     //Reset the paused ticks
-    mPausedTicks = 0;
+    mPausedCounts = 0;
   }
 }
 
-Uint32 LTimer::getTicks()
+Uint64 LTimer::getCounts()
 {
   //The actual timer time
-  Uint32 time = 0;
+  Uint64 time = 0;
 
   //If the timer is running
   if( mStarted ) 
@@ -553,19 +629,42 @@ Uint32 LTimer::getTicks()
     //If the timer is paused
     if( mPaused )
     {
-      //Return the number of ticks when the timer was paused
-      time = mPausedTicks;
+      //Return the number of counts when the timer was paused
+      time = mPausedCounts;
     }
     else
     {
       //Return the current time minus the start time
-      time = SDL_GetTicks() - mStartTicks;
+      time = SDL_GetPerformanceCounter() - mStartCounts;
     }
   }
 
   return time;
 }
 
+Uint64 LTimer::getTime( Uint64 unitsPerSecond )
+{
+  //Convert whole seconds apart from the remainder so the multiply can't overflow
+  Uint64 counts = getCounts();
+  Uint64 frequency = SDL_GetPerformanceFrequency();
+  return counts / frequency * unitsPerSecond + counts % frequency * unitsPerSecond / frequency;
+}
+
+Uint32 LTimer::getTicks()
+{
+  return (Uint32)getTime( 1000 );
+}
+
+Uint64 LTimer::getMicroseconds()
+{
+  return getTime( 1000000 );
+}
+
+Uint64 LTimer::getNanoseconds()
+{
+  return getTime( 1000000000 );
+}
+
 bool LTimer::isStarted()
 {
   //Timer is running and paused or unpaused
@@ -578,11 +677,105 @@ bool LTimer::isPaused()
   return mPaused && mStarted;
 }
 
+LFixedStepLoop::LFixedStepLoop( int ticksPerSecond, int maxTicksPerFrame )
+{
+  //Initialize the variables
+  mTickLength = 1000.f / ticksPerSecond;
+  mMaxTicksPerFrame = maxTicksPerFrame;
+  mAccumulator = 0.f;
+  mFrameTicks = 0;
+  mRenderBudget = mTickLength;
+
+  mDroppedTicks = 0;
+  mSimulationOverruns = 0;
+  mRenderOverruns = 0;
+}
+
+void LFixedStepLoop::start()
+{
+  //Nothing to catch up on yet
+  mAccumulator = 0.f;
+  mFrameTimer.start();
+}
+
+int LFixedStepLoop::beginFrame()
+{
+  //Bank the time since the last frame
+  mAccumulator += mFrameTimer.getMicroseconds() / 1000.f;
+  mFrameTimer.start();
+
+  //Simulate every whole tick that has passed
+  mFrameTicks = (int)( mAccumulator / mTickLength );
+  mAccumulator -= mFrameTicks * mTickLength;
+
+  //Drop what can't be caught up on instead of falling further behind
+  if( mFrameTicks > mMaxTicksPerFrame )
+  {
+    mDroppedTicks += mFrameTicks - mMaxTicksPerFrame;
+    mFrameTicks = mMaxTicksPerFrame;
+  }
+
+  mWorkTimer.start();
+  return mFrameTicks;
+}
+
+void LFixedStepLoop::endSimulation()
+{
+  //The ticks took longer than the time they simulate
+  if( mFrameTicks > 0 && mWorkTimer.getMicroseconds() / 1000.f > mFrameTicks * mTickLength )
+  {
+    mSimulationOverruns++;
+  }
+
+  mWorkTimer.start();
+}
+
+void LFixedStepLoop::endRendering()
+{
+  //Drawing took longer than a frame may
+  if( mWorkTimer.getMicroseconds() / 1000.f > mRenderBudget )
+  {
+    mRenderOverruns++;
+  }
+}
+
+float LFixedStepLoop::getTickSeconds()
+{
+  return mTickLength / 1000.f;
+}
+
+float LFixedStepLoop::getAlpha()
+{
+  return mAccumulator / mTickLength;
+}
+
+void LFixedStepLoop::setRenderBudget( float milliseconds )
+{
+  mRenderBudget = milliseconds;
+}
+
+int LFixedStepLoop::getDroppedTicks()
+{
+  return mDroppedTicks;
+}
+
+int LFixedStepLoop::getSimulationOverruns()
+{
+  return mSimulationOverruns;
+}
+
+int LFixedStepLoop::getRenderOverruns()
+{
+  return mRenderOverruns;
+}
+
 Dot::Dot()
 {
     //Initialize the position
     mPosX = 0;
     mPosY = 0;
+    mPrevPosX = 0;
+    mPrevPosY = 0;
 
     //Initialize the velocity
     mVelX = 0;
@@ -619,6 +812,10 @@ void Dot::handleEvent( SDL_Event& e )
 
 void Dot::move( float timeStep )
 {
+  //Remember where the dot was for interpolation
+  mPrevPosX = mPosX;
+  mPrevPosY = mPosY;
+
   //Move the dot left or right
   mPosX += mVelX * timeStep;
 
@@ -646,10 +843,12 @@ void Dot::move( float timeStep )
   }
 }
 
-void Dot::render()
+void Dot::render( float alpha )
 {
-  //Show the dot
-  gDotTexture.render( (int)mPosX, (int)mPosY );
+  //Show the dot part way from its last position to its current one
+  float x = mPrevPosX + ( mPosX - mPrevPosX ) * alpha;
+  float y = mPrevPosY + ( mPosY - mPrevPosY ) * alpha;
+  gDotTexture.render( (int)x, (int)y );
 }
 
 bool init()
@@ -762,8 +961,17 @@ int main( int argc, char* args[] )
       //The dot that will be moving around on the screen
       Dot dot;
 
-      //Keeps track of time between steps
-      LTimer stepTimer;
+      //Steps the simulation at a fixed rate
+      LFixedStepLoop loop( SIMULATION_TICKS_PER_SECOND, MAX_TICKS_PER_FRAME );
+
+      //Drawing a frame should fit in one display refresh
+      SDL_DisplayMode mode;
+      if( SDL_GetWindowDisplayMode( gWindow, &mode ) == 0 && mode.refresh_rate > 0 )
+      {
+        loop.setRenderBudget( 1000.f / mode.refresh_rate );
+      }
+
+      loop.start();
 
       //While application is running
 			while( !quit )
@@ -781,25 +989,28 @@ int main( int argc, char* args[] )
           dot.handleEvent( e );
 				}
 
-        //Calculate time step
-        float timeStep = stepTimer.getTicks() / 1000.f;
-
-        //Move for time step
-        dot.move( timeStep );
-
-        //Restart step timer
-        stepTimer.start();
+        //Move in fixed ticks for however much time has passed
+        int ticks = loop.beginFrame();
+        for( int tick = 0; tick < ticks; ++tick )
+        {
+          dot.move( loop.getTickSeconds() );
+        }
+        loop.endSimulation();
 
 				//Clear screen
 				SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
 				SDL_RenderClear( gRenderer );
 
-        //Render dot
-        dot.render();
+        //Render dot between the last two ticks
+        dot.render( loop.getAlpha() );
+        loop.endRendering();
 
 				//Update screen
 				SDL_RenderPresent( gRenderer );
 			}
+
+      //Report missed budgets
+      printf( "Dropped ticks: %d, slow simulation frames: %d, slow render frames: %d\n", loop.getDroppedTicks(), loop.getSimulationOverruns(), loop.getRenderOverruns() );
 		}
 	}
 
@@ -1,9 +1,23 @@
-//Using SDL, SDL_image, standard IO, and strings
+//Using SDL, SDL_image, SDL_threads, standard IO, strings, vectors, deques, functions, and shared pointers
 #include <SDL.h>
 #include <SDL_thread.h>
 #include <SDL_image.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <utility>
+
+//Pinning worker threads to cores
+#if defined( _WIN32 )
+#include <windows.h>
+#elif defined( __linux__ )
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 640;
@@ -82,9 +96,226 @@ class LTexture
 		int mHeight;
 };
 
+//A unit of work for the thread pool
+typedef std::function<void()> LTask;
+
+//Counts tasks that haven't finished yet
+class LTaskGroup
+{
+	public:
+		//Initializes variables
+		LTaskGroup();
+
+		//Expects more tasks
+		void add( int count );
+
+		//Marks a task finished
+		void finish();
+
+		//Checks if every task has finished
+		bool isDone();
+
+	private:
+		//Tasks left to finish
+		SDL_atomic_t mRemaining;
+};
+
+class LThreadPool;
+
+//What a pool task returned, shared by the task and its future
+template<typename T>
+struct LFutureState
+{
+	//Calls the task's function and keeps what it returns
+	template<typename F>
+	void run( const F& function ) { value = function(); }
+
+	//Done when the task is
+	LTaskGroup group;
+
+	//The returned value
+	T value;
+};
+
+//Tasks that return nothing only have to say when they're done
+template<>
+struct LFutureState<void>
+{
+	//Calls the task's function
+	template<typename F>
+	void run( const F& function ) { function(); }
+
+	//Done when the task is
+	LTaskGroup group;
+};
+
+//Handle to the result of a pool task
+template<typename T>
+class LFuture
+{
+	public:
+		//Initializes variables
+		LFuture();
+		LFuture( LThreadPool* pool, std::shared_ptr< LFutureState<T> > state );
+
+		//Checks if the result is in
+		bool isReady();
+
+		//Gets the result, helping the pool until it's in
+		T& get();
+
+	private:
+		//Pool the task runs on
+		LThreadPool* mPool;
+
+		//Result shared with the task
+		std::shared_ptr< LFutureState<T> > mState;
+};
+
+//Handle to a pool task that returns nothing
+template<>
+class LFuture<void>
+{
+	public:
+		//Initializes variables
+		LFuture();
+		LFuture( LThreadPool* pool, std::shared_ptr< LFutureState<void> > state );
+
+		//Checks if the task is done
+		bool isReady();
+
+		//Helps the pool until the task is done
+		void get();
+
+	private:
+		//Pool the task runs on
+		LThreadPool* mPool;
+
+		//Completion shared with the task
+		std::shared_ptr< LFutureState<void> > mState;
+};
+
+//A queued pool task
+struct LPoolTask
+{
+	//What to run
+	LTask function;
+
+	//Group to tell when it's done, if any
+	LTaskGroup* group;
+};
+
+//A worker thread and its tasks, on its own cache line so workers don't slow each other down
+struct alignas( 64 ) LWorker
+{
+	//Pool the worker belongs to
+	LThreadPool* pool;
+
+	//Position in the pool
+	int index;
+
+	//The worker thread
+	SDL_Thread* thread;
+
+	//Guards the tasks
+	SDL_SpinLock lock;
+
+	//The owner works from the back, thieves take from the front
+	std::deque<LPoolTask> tasks;
+};
+
+//Persistent worker threads that balance tasks by stealing from each other
+class LThreadPool
+{
+	public:
+		//Initializes variables
+		LThreadPool();
+
+		//Deallocates memory
+		~LThreadPool();
+
+		//Starts workers pinned to cores, by default one for each core but the main thread's
+		bool start( int workerCount = 0 );
+
+		//Finishes queued tasks and joins the workers
+		void stop();
+
+		//Gets the number of workers
+		int getWorkerCount();
+
+		//Queues a task, counting it in a group if given
+		void submit( LTask task, LTaskGroup* group = NULL );
+
+		//Queues a function and gets a future for what it returns
+		template<typename F>
+		auto async( F function ) -> LFuture<decltype( function() )>;
+
+		//Calls body on chunks of [begin, end) across the pool and waits for them, grain 0 picks the chunk size
+		void parallelFor( int begin, int end, int grain, std::function<void( int, int )> body );
+
+		//Runs pool tasks on the calling thread until the group is done
+		void wait( LTaskGroup& group );
+
+	private:
+		//Worker thread entry point
+		static int workerThread( void* data );
+
+		//Gets the cores the process may run on, empty where that can't be asked
+		static std::vector<int> getAllowedCores();
+
+		//Keeps the calling thread on one core, false if the system refused
+		static bool pinToCore( int core );
+
+		//Runs tasks until the pool stops
+		void work( int index );
+
+		//Runs one queued task, the worker's own first, then one stolen from the others
+		bool runTask( int index );
+
+		//Takes the newest task of a worker
+		bool popTask( int index, LPoolTask& task );
+
+		//Takes the oldest task of a worker
+		bool stealTask( int index, LPoolTask& task );
+
+		//Gets the calling worker's index, -1 for threads outside the pool
+		int getWorkerIndex();
+
+		//Workers and their tasks
+		std::vector<LWorker> mWorkers;
+
+		//Cores workers get pinned to
+		std::vector<int> mCores;
+
+		//Tells worker threads apart
+		SDL_TLSID mWorkerSlot;
+
+		//Tasks queued but not taken yet
+		SDL_atomic_t mPending;
+
+		//Workers waiting for tasks
+		SDL_atomic_t mSleeping;
+
+		//Cleared when workers should quit once out of tasks
+		SDL_atomic_t mRunning;
+
+		//Where the next task from outside the pool goes
+		SDL_atomic_t mNextWorker;
+
+		//Idle workers wait here
+		SDL_mutex* mWakeLock;
+		SDL_cond* mWakeCondition;
+};
+
 //Our test thread function
 int threadFunction( void* data );
 
+//Runs an LTask as a thread function
+int taskThread( void* data );
+
+//Compares the thread pool with a thread per task
+void benchmarkThreadPool();
+
 //Starts up SDL and creates window
 bool init();
 
@@ -103,6 +334,9 @@ SDL_Renderer* gRenderer = NULL;
 //Scene textures
 LTexture gSplashTexture;
 
+//Shared worker threads
+LThreadPool gThreadPool;
+
 LTexture::LTexture()
 {
 	//Initialize
@@ -420,6 +654,545 @@ void LTexture::copyRawPixels32( void* pixels )
 	}
 }
 
+LTaskGroup::LTaskGroup()
+{
+	//Initialize
+	SDL_AtomicSet( &mRemaining, 0 );
+}
+
+void LTaskGroup::add( int count )
+{
+	SDL_AtomicAdd( &mRemaining, count );
+}
+
+void LTaskGroup::finish()
+{
+	SDL_AtomicAdd( &mRemaining, -1 );
+}
+
+bool LTaskGroup::isDone()
+{
+	return SDL_AtomicGet( &mRemaining ) == 0;
+}
+
+template<typename T>
+LFuture<T>::LFuture()
+{
+	//Initialize
+	mPool = NULL;
+}
+
+template<typename T>
+LFuture<T>::LFuture( LThreadPool* pool, std::shared_ptr< LFutureState<T> > state )
+{
+	//Initialize
+	mPool = pool;
+	mState = state;
+}
+
+template<typename T>
+bool LFuture<T>::isReady()
+{
+	return mState != NULL && mState->group.isDone();
+}
+
+template<typename T>
+T& LFuture<T>::get()
+{
+	//Help with queued tasks instead of blocking
+	mPool->wait( mState->group );
+
+	return mState->value;
+}
+
+LFuture<void>::LFuture()
+{
+	//Initialize
+	mPool = NULL;
+}
+
+LFuture<void>::LFuture( LThreadPool* pool, std::shared_ptr< LFutureState<void> > state )
+{
+	//Initialize
+	mPool = pool;
+	mState = state;
+}
+
+bool LFuture<void>::isReady()
+{
+	return mState != NULL && mState->group.isDone();
+}
+
+void LFuture<void>::get()
+{
+	//Help with queued tasks instead of blocking
+	mPool->wait( mState->group );
+}
+
+LThreadPool::LThreadPool()
+{
+	//Initialize
+	mWorkerSlot = 0;
+	mWakeLock = NULL;
+	mWakeCondition = NULL;
+	SDL_AtomicSet( &mPending, 0 );
+	SDL_AtomicSet( &mSleeping, 0 );
+	SDL_AtomicSet( &mRunning, 0 );
+	SDL_AtomicSet( &mNextWorker, 0 );
+}
+
+LThreadPool::~LThreadPool()
+{
+	//Deallocate
+	stop();
+}
+
+bool LThreadPool::start( int workerCount )
+{
+	//Get rid of preexisting workers
+	stop();
+
+	//Only use cores the process is allowed on, a cpuset or taskset can exclude some
+	mCores = getAllowedCores();
+
+	//Leave a core for the main thread
+	if( workerCount <= 0 )
+	{
+		workerCount = ( mCores.empty() ? SDL_GetCPUCount() : (int)mCores.size() ) - 1;
+		if( workerCount < 1 )
+		{
+			workerCount = 1;
+		}
+	}
+
+	//Create wake up signal
+	mWakeLock = SDL_CreateMutex();
+	mWakeCondition = SDL_CreateCond();
+	if( mWorkerSlot == 0 )
+	{
+		mWorkerSlot = SDL_TLSCreate();
+	}
+	if( mWakeLock == NULL || mWakeCondition == NULL || mWorkerSlot == 0 )
+	{
+		printf( "Unable to create thread pool signals! SDL Error: %s\n", SDL_GetError() );
+		stop();
+		return false;
+	}
+
+	//Set up every worker before any of them can steal
+	mWorkers.resize( workerCount );
+	for( int i = 0; i < workerCount; ++i )
+	{
+		mWorkers[ i ].pool = this;
+		mWorkers[ i ].index = i;
+		mWorkers[ i ].thread = NULL;
+		mWorkers[ i ].lock = 0;
+	}
+
+	//Start the threads
+	SDL_AtomicSet( &mRunning, 1 );
+	for( int i = 0; i < workerCount; ++i )
+	{
+		mWorkers[ i ].thread = SDL_CreateThread( workerThread, "Pool worker", &mWorkers[ i ] );
+		if( mWorkers[ i ].thread == NULL )
+		{
+			printf( "Unable to create pool worker! SDL Error: %s\n", SDL_GetError() );
+			stop();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void LThreadPool::stop()
+{
+	//Tell workers to quit once out of tasks
+	SDL_AtomicSet( &mRunning, 0 );
+	if( mWakeLock != NULL )
+	{
+		SDL_LockMutex( mWakeLock );
+		SDL_CondBroadcast( mWakeCondition );
+		SDL_UnlockMutex( mWakeLock );
+	}
+
+	//Wait for them
+	for( size_t i = 0; i < mWorkers.size(); ++i )
+	{
+		if( mWorkers[ i ].thread != NULL )
+		{
+			SDL_WaitThread( mWorkers[ i ].thread, NULL );
+		}
+	}
+	mWorkers.clear();
+
+	//Free wake up signal
+	if( mWakeCondition != NULL )
+	{
+		SDL_DestroyCond( mWakeCondition );
+		mWakeCondition = NULL;
+	}
+	if( mWakeLock != NULL )
+	{
+		SDL_DestroyMutex( mWakeLock );
+		mWakeLock = NULL;
+	}
+}
+
+int LThreadPool::getWorkerCount()
+{
+	return mWorkers.size();
+}
+
+void LThreadPool::submit( LTask task, LTaskGroup* group )
+{
+	//Count the task before anyone can finish it
+	if( group != NULL )
+	{
+		group->add( 1 );
+	}
+
+	//Without workers run the task right away
+	if( mWorkers.empty() )
+	{
+		task();
+		if( group != NULL )
+		{
+			group->finish();
+		}
+		return;
+	}
+
+	//Workers queue their own tasks, others spread them around
+	int index = getWorkerIndex();
+	if( index < 0 )
+	{
+		index = ( SDL_AtomicAdd( &mNextWorker, 1 ) & 0x7FFFFFFF ) % mWorkers.size();
+	}
+
+	//Queue the task
+	LPoolTask queued;
+	queued.function = std::move( task );
+	queued.group = group;
+	LWorker& worker = mWorkers[ index ];
+	SDL_AtomicLock( &worker.lock );
+	worker.tasks.push_back( std::move( queued ) );
+	SDL_AtomicUnlock( &worker.lock );
+
+	//Wake a worker if they're all idle
+	SDL_AtomicIncRef( &mPending );
+	if( SDL_AtomicGet( &mSleeping ) > 0 )
+	{
+		SDL_LockMutex( mWakeLock );
+		SDL_CondSignal( mWakeCondition );
+		SDL_UnlockMutex( mWakeLock );
+	}
+}
+
+template<typename F>
+auto LThreadPool::async( F function ) -> LFuture<decltype( function() )>
+{
+	typedef decltype( function() ) Result;
+
+	//The task keeps the result alive until it's done writing it
+	std::shared_ptr< LFutureState<Result> > state( new LFutureState<Result>() );
+	submit( [ state, function ]() { state->run( function ); }, &state->group );
+
+	return LFuture<Result>( this, state );
+}
+
+void LThreadPool::parallelFor( int begin, int end, int grain, std::function<void( int, int )> body )
+{
+	//A few chunks per thread so faster ones can steal the rest
+	int count = end - begin;
+	if( count <= 0 )
+	{
+		return;
+	}
+	if( grain <= 0 )
+	{
+		grain = count / ( ( getWorkerCount() + 1 ) * 4 );
+		if( grain < 1 )
+		{
+			grain = 1;
+		}
+	}
+
+	//Queue the chunks and help run them
+	LTaskGroup group;
+	for( int first = begin; first < end; first += grain )
+	{
+		int last = first + grain < end ? first + grain : end;
+		submit( [ &body, first, last ]() { body( first, last ); }, &group );
+	}
+	wait( group );
+}
+
+void LThreadPool::wait( LTaskGroup& group )
+{
+	int index = getWorkerIndex();
+	while( !group.isDone() )
+	{
+		//Give the core to whoever is finishing the last tasks
+		if( !runTask( index ) )
+		{
+			SDL_Delay( 0 );
+		}
+	}
+}
+
+int LThreadPool::workerThread( void* data )
+{
+	LWorker* worker = static_cast<LWorker*>( data );
+	worker->pool->work( worker->index );
+
+	return 0;
+}
+
+std::vector<int> LThreadPool::getAllowedCores()
+{
+	std::vector<int> cores;
+
+	#if defined( _WIN32 )
+	DWORD_PTR processMask, systemMask;
+	if( GetProcessAffinityMask( GetCurrentProcess(), &processMask, &systemMask ) )
+	{
+		for( int core = 0; core < (int)sizeof( DWORD_PTR ) * 8; ++core )
+		{
+			if( processMask & ( (DWORD_PTR)1 << core ) )
+			{
+				cores.push_back( core );
+			}
+		}
+	}
+	#elif defined( __linux__ )
+	cpu_set_t allowed;
+	CPU_ZERO( &allowed );
+	if( sched_getaffinity( 0, sizeof( allowed ), &allowed ) == 0 )
+	{
+		for( int core = 0; core < CPU_SETSIZE; ++core )
+		{
+			if( CPU_ISSET( core, &allowed ) )
+			{
+				cores.push_back( core );
+			}
+		}
+	}
+	#endif
+
+	return cores;
+}
+
+bool LThreadPool::pinToCore( int core )
+{
+	#if defined( _WIN32 )
+	return SetThreadAffinityMask( GetCurrentThread(), (DWORD_PTR)1 << core ) != 0;
+	#elif defined( __linux__ )
+	cpu_set_t cores;
+	CPU_ZERO( &cores );
+	CPU_SET( core, &cores );
+	return pthread_setaffinity_np( pthread_self(), sizeof( cores ), &cores ) == 0;
+	#else
+	//Other platforms only take hints, let the scheduler place the thread
+	(void)core;
+	return true;
+	#endif
+}
+
+void LThreadPool::work( int index )
+{
+	//The main thread isn't pinned, but by default there's one fewer worker than allowed cores,
+	//so starting from the second core leaves the first free for the scheduler to put it on
+	if( !mCores.empty() )
+	{
+		int core = mCores[ ( index + 1 ) % mCores.size() ];
+		if( !pinToCore( core ) )
+		{
+			printf( "Unable to pin pool worker %d to core %d!\n", index, core );
+		}
+	}
+	SDL_TLSSet( mWorkerSlot, (void*)(intptr_t)( index + 1 ), NULL );
+
+	while( true )
+	{
+		//Keep going while there's work
+		if( runTask( index ) )
+		{
+			continue;
+		}
+
+		//Quit once stopped and out of tasks
+		if( SDL_AtomicGet( &mRunning ) == 0 && SDL_AtomicGet( &mPending ) == 0 )
+		{
+			break;
+		}
+
+		//Sleep until a task is queued, counting ourselves idle first so submit can't miss us
+		SDL_LockMutex( mWakeLock );
+		SDL_AtomicIncRef( &mSleeping );
+		while( SDL_AtomicGet( &mPending ) == 0 && SDL_AtomicGet( &mRunning ) != 0 )
+		{
+			SDL_CondWait( mWakeCondition, mWakeLock );
+		}
+		SDL_AtomicAdd( &mSleeping, -1 );
+		SDL_UnlockMutex( mWakeLock );
+	}
+}
+
+bool LThreadPool::runTask( int index )
+{
+	//Own tasks first while they're hot in cache
+	LPoolTask task;
+	bool found = index >= 0 && popTask( index, task );
+
+	//Then steal, starting past ourselves so thieves spread out
+	int workerCount = mWorkers.size();
+	for( int i = 1; !found && i <= workerCount; ++i )
+	{
+		found = stealTask( ( index + i + workerCount ) % workerCount, task );
+	}
+
+	//Run it
+	if( found )
+	{
+		task.function();
+		if( task.group != NULL )
+		{
+			task.group->finish();
+		}
+	}
+
+	return found;
+}
+
+bool LThreadPool::popTask( int index, LPoolTask& task )
+{
+	LWorker& worker = mWorkers[ index ];
+	bool found = false;
+
+	SDL_AtomicLock( &worker.lock );
+	if( !worker.tasks.empty() )
+	{
+		task = std::move( worker.tasks.back() );
+		worker.tasks.pop_back();
+		found = true;
+	}
+	SDL_AtomicUnlock( &worker.lock );
+
+	if( found )
+	{
+		SDL_AtomicAdd( &mPending, -1 );
+	}
+
+	return found;
+}
+
+bool LThreadPool::stealTask( int index, LPoolTask& task )
+{
+	LWorker& worker = mWorkers[ index ];
+	bool found = false;
+
+	SDL_AtomicLock( &worker.lock );
+	if( !worker.tasks.empty() )
+	{
+		task = std::move( worker.tasks.front() );
+		worker.tasks.pop_front();
+		found = true;
+	}
+	SDL_AtomicUnlock( &worker.lock );
+
+	if( found )
+	{
+		SDL_AtomicAdd( &mPending, -1 );
+	}
+
+	return found;
+}
+
+int LThreadPool::getWorkerIndex()
+{
+	return (int)(intptr_t)SDL_TLSGet( mWorkerSlot ) - 1;
+}
+
+int taskThread( void* data )
+{
+	( *static_cast<LTask*>( data ) )();
+
+	return 0;
+}
+
+void benchmarkThreadPool()
+{
+	const int TASK_COUNT = 2000;
+	const int TASK_SIZE = 2000;
+	const int PARTICLE_COUNT = 1 << 22;
+
+	//Small tasks like a frame's worth of jobs
+	std::vector<double> results( TASK_COUNT );
+	std::function<void( int )> job = [ &results ]( int t )
+	{
+		double sum = 0.0;
+		for( int i = 0; i < TASK_SIZE; ++i )
+		{
+			sum += ( t + i ) * 0.5;
+		}
+		results[ t ] = sum;
+	};
+
+	//A thread for every task
+	Uint64 start = SDL_GetPerformanceCounter();
+	for( int t = 0; t < TASK_COUNT; ++t )
+	{
+		LTask task = [ &job, t ]() { job( t ); };
+		SDL_Thread* thread = SDL_CreateThread( taskThread, "Task", &task );
+		SDL_WaitThread( thread, NULL );
+	}
+	double threadTime = (double)( SDL_GetPerformanceCounter() - start ) * 1000.0 / SDL_GetPerformanceFrequency();
+
+	//The same tasks on the pool
+	start = SDL_GetPerformanceCounter();
+	LTaskGroup group;
+	for( int t = 0; t < TASK_COUNT; ++t )
+	{
+		gThreadPool.submit( [ &job, t ]() { job( t ); }, &group );
+	}
+	gThreadPool.wait( group );
+	double poolTime = (double)( SDL_GetPerformanceCounter() - start ) * 1000.0 / SDL_GetPerformanceFrequency();
+
+	printf( "%d tasks: thread per task %.2f ms, %d worker pool %.2f ms\n", TASK_COUNT, threadTime, gThreadPool.getWorkerCount(), poolTime );
+
+	//Particle update over every core
+	std::vector<float> positions( PARTICLE_COUNT, 0.f );
+	std::vector<float> velocities( PARTICLE_COUNT );
+	for( int i = 0; i < PARTICLE_COUNT; ++i )
+	{
+		velocities[ i ] = (float)( i % 17 ) - 8.f;
+	}
+	std::function<void( int, int )> update = [ &positions, &velocities ]( int first, int last )
+	{
+		for( int i = first; i < last; ++i )
+		{
+			positions[ i ] += velocities[ i ] / 60.f;
+		}
+	};
+
+	start = SDL_GetPerformanceCounter();
+	for( int frame = 0; frame < 60; ++frame )
+	{
+		update( 0, PARTICLE_COUNT );
+	}
+	double serialTime = (double)( SDL_GetPerformanceCounter() - start ) * 1000.0 / SDL_GetPerformanceFrequency() / 60;
+
+	start = SDL_GetPerformanceCounter();
+	for( int frame = 0; frame < 60; ++frame )
+	{
+		gThreadPool.parallelFor( 0, PARTICLE_COUNT, 0, update );
+	}
+	double parallelTime = (double)( SDL_GetPerformanceCounter() - start ) * 1000.0 / SDL_GetPerformanceFrequency() / 60;
+
+	printf( "%d particles: serial %.3f ms/frame, parallel_for %.3f ms/frame\n", PARTICLE_COUNT, serialTime, parallelTime );
+}
+
 int threadFunction( void* data )
 {
   //Print incoming data
@@ -477,6 +1250,13 @@ bool init()
 				}
 			}
 		}
+
+		//Start worker threads
+		if( !gThreadPool.start() )
+		{
+			printf( "Unable to start thread pool!\n" );
+			success = false;
+		}
 	}
 
 	return success;
@@ -502,6 +1282,9 @@ void close()
 	//Free loaded images
 	gSplashTexture.free();
 
+	//Join worker threads
+	gThreadPool.stop();
+
 	//Destroy window
 	SDL_DestroyRenderer( gRenderer );
 	SDL_DestroyWindow( gWindow );
@@ -515,6 +1298,15 @@ void close()
 
 int main( int argc, char* args[] )
 {
+	//Time the thread pool without opening a window
+	if( argc > 1 && std::string( args[ 1 ] ) == "--benchmark" )
+	{
+		gThreadPool.start();
+		benchmarkThreadPool();
+		gThreadPool.stop();
+		return 0;
+	}
+
 	//Start up SDL and create window
 	if( !init() )
 	{
@@ -535,9 +1327,9 @@ int main( int argc, char* args[] )
 			//Event handler
 			SDL_Event e;
 
-      //Run the thread
+      //Run the function on the pool
       long data = 101;
-      SDL_Thread* threadID = SDL_CreateThread( threadFunction , "lazyThread", (void*)data );
+      LFuture<int> threadResult = gThreadPool.async( [ data ]() { return threadFunction( (void*)data ); } );
       
       //While application is running
 			while( !quit )
@@ -564,8 +1356,8 @@ int main( int argc, char* args[] )
 				SDL_RenderPresent( gRenderer );
 			}
 
-      //Wait for thread to finish
-      SDL_WaitThread ( threadID, NULL );
+      //Wait for task to finish
+      threadResult.get();
 		}
 	}
 
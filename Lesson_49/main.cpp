@@ -1,14 +1,21 @@
-//Using SDL, SDL_image, standard IO, and strings
+//Using SDL, SDL_image, SDL_threads, standard IO, strings, and vectors
 #include <SDL.h>
 #include <SDL_thread.h>
 #include <SDL_image.h>
 #include <stdio.h>
 #include <string>
+#include <vector>
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+//Items the producer can get ahead of the consumer
+const int BUFFER_CAPACITY = 4;
+
+//Times a blocking ring retries before it sleeps
+const int RING_SPIN_COUNT = 64;
+
 //Texture wrapper class
 class LTexture
 {
@@ -82,12 +89,180 @@ class LTexture
 		int mHeight;
 };
 
+//Lock free ring buffer for one producer thread and one consumer thread
+template<typename T>
+class LSPSCRing
+{
+	public:
+		//Initializes variables
+		LSPSCRing();
+
+		//Allocates slots, rounding up to a power of two
+		bool create( int capacity );
+
+		//Deallocates slots
+		void free();
+
+		//Adds an item if there's room, producer only
+		bool push( const T& item );
+
+		//Adds as many items as fit and gets how many did, producer only
+		int pushBatch( const T* items, int count );
+
+		//Takes the oldest item if there is one, consumer only
+		bool pop( T& item );
+
+		//Takes up to count items and gets how many it did, consumer only
+		int popBatch( T* items, int count );
+
+		//Gets the number of items, exact only on the producer or consumer thread
+		int getSize();
+
+		//Gets the number of slots
+		int getCapacity();
+
+	private:
+		//The slots
+		std::vector<T> mItems;
+		Uint32 mMask;
+
+		//Next slot to fill, with the producer's last look at the consumer
+		alignas( 64 ) SDL_atomic_t mTail;
+		Uint32 mCachedHead;
+
+		//Next slot to take, with the consumer's last look at the producer
+		alignas( 64 ) SDL_atomic_t mHead;
+		Uint32 mCachedTail;
+};
+
+//A slot in a multi producer multi consumer ring
+template<typename T>
+struct LRingCell
+{
+	//Which lap of the ring the slot is ready for
+	SDL_atomic_t sequence;
+
+	//The stored item
+	T item;
+};
+
+//Lock free ring buffer any number of threads can push to and pop from
+template<typename T>
+class LMPMCRing
+{
+	public:
+		//Initializes variables
+		LMPMCRing();
+
+		//Allocates slots, rounding up to a power of two
+		bool create( int capacity );
+
+		//Deallocates slots
+		void free();
+
+		//Adds an item if there's room
+		bool push( const T& item );
+
+		//Claims as many free slots as it can in one go and gets how many items went in
+		int pushBatch( const T* items, int count );
+
+		//Takes the oldest item if there is one
+		bool pop( T& item );
+
+		//Claims as many filled slots as it can in one go and gets how many items came out
+		int popBatch( T* items, int count );
+
+		//Gets the number of claimed slots, which may still be being filled or emptied
+		int getSize();
+
+		//Gets the number of slots
+		int getCapacity();
+
+	private:
+		//The slots
+		std::vector< LRingCell<T> > mCells;
+		Uint32 mMask;
+
+		//Next slot to fill
+		alignas( 64 ) SDL_atomic_t mTail;
+
+		//Next slot to take
+		alignas( 64 ) SDL_atomic_t mHead;
+};
+
+//Puts threads to sleep on a lock free ring when it's full or empty
+template<typename T, typename Ring>
+class LBlockingRing
+{
+	public:
+		//Initializes variables
+		LBlockingRing();
+
+		//Deallocates memory
+		~LBlockingRing();
+
+		//Allocates the ring and its signals
+		bool create( int capacity );
+
+		//Deallocates the ring and its signals
+		void free();
+
+		//Adds an item, waiting for room
+		bool push( const T& item );
+
+		//Adds every item, waiting for room as needed
+		bool pushBatch( const T* items, int count );
+
+		//Takes an item, waiting for one, fails once closed and empty
+		bool pop( T& item );
+
+		//Takes up to count items, waiting for at least one, gets 0 once closed and empty
+		int popBatch( T* items, int count );
+
+		//Adds an item without waiting
+		bool tryPush( const T& item );
+
+		//Takes an item without waiting
+		bool tryPop( T& item );
+
+		//Wakes every waiter and stops further waits
+		void close();
+
+	private:
+		//Sleeps until the ring has room
+		bool waitForRoom();
+
+		//Sleeps until the ring has items
+		bool waitForItems();
+
+		//Wakes a waiter if there is one
+		void signal( SDL_cond* condition, SDL_atomic_t* waiters );
+
+		//The lock free ring
+		Ring mRing;
+
+		//Sleeping threads wait here
+		SDL_mutex* mLock;
+		SDL_cond* mCanPush;
+		SDL_cond* mCanPop;
+
+		//Threads asleep on each condition
+		SDL_atomic_t mPushWaiters;
+		SDL_atomic_t mPopWaiters;
+
+		//Set once no more items are coming
+		SDL_atomic_t mClosed;
+};
+
 //Our worker functions
 int producer( void* data );
 int consumer( void* data );
 void produce();
 void consume();
 
+//Compares the rings with a locked single slot buffer
+void benchmarkRings();
+
 //Starts up SDL and creates window
 bool init();
 
@@ -103,15 +278,8 @@ SDL_Window* gWindow = NULL;
 //The window renderer
 SDL_Renderer* gRenderer = NULL;
 
-//The protective mutex
-SDL_mutex* gBufferLock = NULL;
-
-//The conditions
-SDL_cond* gCanProduce = NULL;
-SDL_cond* gCanConsume = NULL;
-
-//The "data buffer"
-int gData = -1;
+//The data buffer
+LBlockingRing< int, LSPSCRing<int> > gBuffer;
 
 //Scene textures
 LTexture gSplashTexture;
@@ -433,6 +601,535 @@ void LTexture::copyRawPixels32( void* pixels )
 	}
 }
 
+template<typename T>
+LSPSCRing<T>::LSPSCRing()
+{
+	//Initialize
+	mMask = 0;
+	mCachedHead = 0;
+	mCachedTail = 0;
+	SDL_AtomicSet( &mTail, 0 );
+	SDL_AtomicSet( &mHead, 0 );
+}
+
+template<typename T>
+bool LSPSCRing<T>::create( int capacity )
+{
+	//Power of two sizes let positions wrap with a mask
+	Uint32 size = 1;
+	while( size < (Uint32)capacity )
+	{
+		size <<= 1;
+	}
+
+	mItems.assign( size, T() );
+	mMask = size - 1;
+	mCachedHead = 0;
+	mCachedTail = 0;
+	SDL_AtomicSet( &mTail, 0 );
+	SDL_AtomicSet( &mHead, 0 );
+
+	return true;
+}
+
+template<typename T>
+void LSPSCRing<T>::free()
+{
+	mItems.clear();
+	mMask = 0;
+}
+
+template<typename T>
+bool LSPSCRing<T>::push( const T& item )
+{
+	return pushBatch( &item, 1 ) == 1;
+}
+
+template<typename T>
+int LSPSCRing<T>::pushBatch( const T* items, int count )
+{
+	//Only look at the consumer's position when the old one says we're full
+	Uint32 tail = (Uint32)SDL_AtomicGet( &mTail );
+	Uint32 capacity = (Uint32)mItems.size();
+	if( capacity - ( tail - mCachedHead ) < (Uint32)count )
+	{
+		mCachedHead = (Uint32)SDL_AtomicGet( &mHead );
+
+		//Don't overwrite slots before the consumer is done reading them
+		SDL_MemoryBarrierAcquire();
+	}
+
+	//Fill what room there is
+	Uint32 room = capacity - ( tail - mCachedHead );
+	if( (Uint32)count > room )
+	{
+		count = (int)room;
+	}
+	for( int i = 0; i < count; ++i )
+	{
+		mItems[ ( tail + i ) & mMask ] = items[ i ];
+	}
+
+	//Publish them all at once, after the items are written
+	if( count > 0 )
+	{
+		SDL_MemoryBarrierRelease();
+		SDL_AtomicSet( &mTail, (int)( tail + count ) );
+	}
+
+	return count;
+}
+
+template<typename T>
+bool LSPSCRing<T>::pop( T& item )
+{
+	return popBatch( &item, 1 ) == 1;
+}
+
+template<typename T>
+int LSPSCRing<T>::popBatch( T* items, int count )
+{
+	//Only look at the producer's position when the old one says we're short
+	Uint32 head = (Uint32)SDL_AtomicGet( &mHead );
+	if( mCachedTail - head < (Uint32)count )
+	{
+		mCachedTail = (Uint32)SDL_AtomicGet( &mTail );
+
+		//Don't read slots before the producer's writes to them show up
+		SDL_MemoryBarrierAcquire();
+	}
+
+	//Take what's there
+	Uint32 available = mCachedTail - head;
+	if( (Uint32)count > available )
+	{
+		count = (int)available;
+	}
+	for( int i = 0; i < count; ++i )
+	{
+		items[ i ] = mItems[ ( head + i ) & mMask ];
+	}
+
+	//Hand the slots back all at once, after the items are read
+	if( count > 0 )
+	{
+		SDL_MemoryBarrierRelease();
+		SDL_AtomicSet( &mHead, (int)( head + count ) );
+	}
+
+	return count;
+}
+
+template<typename T>
+int LSPSCRing<T>::getSize()
+{
+	return (int)( (Uint32)SDL_AtomicGet( &mTail ) - (Uint32)SDL_AtomicGet( &mHead ) );
+}
+
+template<typename T>
+int LSPSCRing<T>::getCapacity()
+{
+	return (int)mItems.size();
+}
+
+template<typename T>
+LMPMCRing<T>::LMPMCRing()
+{
+	//Initialize
+	mMask = 0;
+	SDL_AtomicSet( &mTail, 0 );
+	SDL_AtomicSet( &mHead, 0 );
+}
+
+template<typename T>
+bool LMPMCRing<T>::create( int capacity )
+{
+	//Power of two sizes let positions wrap with a mask
+	Uint32 size = 1;
+	while( size < (Uint32)capacity )
+	{
+		size <<= 1;
+	}
+
+	//Every slot starts ready for the first lap
+	mCells = std::vector< LRingCell<T> >( size );
+	for( Uint32 i = 0; i < size; ++i )
+	{
+		SDL_AtomicSet( &mCells[ i ].sequence, (int)i );
+	}
+	mMask = size - 1;
+	SDL_AtomicSet( &mTail, 0 );
+	SDL_AtomicSet( &mHead, 0 );
+
+	return true;
+}
+
+template<typename T>
+void LMPMCRing<T>::free()
+{
+	mCells.clear();
+	mMask = 0;
+}
+
+template<typename T>
+bool LMPMCRing<T>::push( const T& item )
+{
+	return pushBatch( &item, 1 ) == 1;
+}
+
+template<typename T>
+int LMPMCRing<T>::pushBatch( const T* items, int count )
+{
+	Uint32 tail = (Uint32)SDL_AtomicGet( &mTail );
+	int claimed = 0;
+	while( count > 0 )
+	{
+		//Count the free slots in a row starting at the tail
+		claimed = 0;
+		bool moved = false;
+		while( claimed < count )
+		{
+			Uint32 position = tail + claimed;
+			Sint32 lap = (Sint32)( (Uint32)SDL_AtomicGet( &mCells[ position & mMask ].sequence ) - position );
+			if( lap < 0 )
+			{
+				//Still holds an item from the last lap
+				break;
+			}
+			if( lap > 0 )
+			{
+				//Another producer got here first
+				moved = true;
+				break;
+			}
+			++claimed;
+		}
+
+		//Start over from the new tail if we fell behind
+		if( moved && claimed == 0 )
+		{
+			tail = (Uint32)SDL_AtomicGet( &mTail );
+			continue;
+		}
+
+		//Full
+		if( claimed == 0 )
+		{
+			return 0;
+		}
+
+		//Claim the slots in one go
+		if( SDL_AtomicCAS( &mTail, (int)tail, (int)( tail + claimed ) ) )
+		{
+			break;
+		}
+		tail = (Uint32)SDL_AtomicGet( &mTail );
+	}
+
+	//Don't write the slots before the consumers that freed them are done
+	SDL_MemoryBarrierAcquire();
+
+	//Fill the claimed slots and hand each to the consumers
+	for( int i = 0; i < claimed; ++i )
+	{
+		LRingCell<T>& cell = mCells[ ( tail + i ) & mMask ];
+		cell.item = items[ i ];
+		SDL_MemoryBarrierRelease();
+		SDL_AtomicSet( &cell.sequence, (int)( tail + i + 1 ) );
+	}
+
+	return claimed;
+}
+
+template<typename T>
+bool LMPMCRing<T>::pop( T& item )
+{
+	return popBatch( &item, 1 ) == 1;
+}
+
+template<typename T>
+int LMPMCRing<T>::popBatch( T* items, int count )
+{
+	Uint32 head = (Uint32)SDL_AtomicGet( &mHead );
+	int claimed = 0;
+	while( count > 0 )
+	{
+		//Count the filled slots in a row starting at the head
+		claimed = 0;
+		bool moved = false;
+		while( claimed < count )
+		{
+			Uint32 position = head + claimed;
+			Sint32 lap = (Sint32)( (Uint32)SDL_AtomicGet( &mCells[ position & mMask ].sequence ) - ( position + 1 ) );
+			if( lap < 0 )
+			{
+				//Not filled yet
+				break;
+			}
+			if( lap > 0 )
+			{
+				//Another consumer got here first
+				moved = true;
+				break;
+			}
+			++claimed;
+		}
+
+		//Start over from the new head if we fell behind
+		if( moved && claimed == 0 )
+		{
+			head = (Uint32)SDL_AtomicGet( &mHead );
+			continue;
+		}
+
+		//Empty
+		if( claimed == 0 )
+		{
+			return 0;
+		}
+
+		//Claim the slots in one go
+		if( SDL_AtomicCAS( &mHead, (int)head, (int)( head + claimed ) ) )
+		{
+			break;
+		}
+		head = (Uint32)SDL_AtomicGet( &mHead );
+	}
+
+	//Don't read the slots before the producers' writes to them show up
+	SDL_MemoryBarrierAcquire();
+
+	//Empty the claimed slots and hand each back to the producers for the next lap
+	for( int i = 0; i < claimed; ++i )
+	{
+		LRingCell<T>& cell = mCells[ ( head + i ) & mMask ];
+		items[ i ] = cell.item;
+		SDL_MemoryBarrierRelease();
+		SDL_AtomicSet( &cell.sequence, (int)( head + i + mMask + 1 ) );
+	}
+
+	return claimed;
+}
+
+template<typename T>
+int LMPMCRing<T>::getSize()
+{
+	return (int)( (Uint32)SDL_AtomicGet( &mTail ) - (Uint32)SDL_AtomicGet( &mHead ) );
+}
+
+template<typename T>
+int LMPMCRing<T>::getCapacity()
+{
+	return (int)mCells.size();
+}
+
+template<typename T, typename Ring>
+LBlockingRing<T, Ring>::LBlockingRing()
+{
+	//Initialize
+	mLock = NULL;
+	mCanPush = NULL;
+	mCanPop = NULL;
+	SDL_AtomicSet( &mPushWaiters, 0 );
+	SDL_AtomicSet( &mPopWaiters, 0 );
+	SDL_AtomicSet( &mClosed, 0 );
+}
+
+template<typename T, typename Ring>
+LBlockingRing<T, Ring>::~LBlockingRing()
+{
+	//Deallocate
+	free();
+}
+
+template<typename T, typename Ring>
+bool LBlockingRing<T, Ring>::create( int capacity )
+{
+	//Get rid of preexisting ring
+	free();
+
+	//Create the signals
+	mLock = SDL_CreateMutex();
+	mCanPush = SDL_CreateCond();
+	mCanPop = SDL_CreateCond();
+	if( mLock == NULL || mCanPush == NULL || mCanPop == NULL )
+	{
+		printf( "Unable to create ring signals! SDL Error: %s\n", SDL_GetError() );
+		free();
+		return false;
+	}
+
+	SDL_AtomicSet( &mClosed, 0 );
+	return mRing.create( capacity );
+}
+
+template<typename T, typename Ring>
+void LBlockingRing<T, Ring>::free()
+{
+	//Destroy the signals
+	if( mCanPush != NULL )
+	{
+		SDL_DestroyCond( mCanPush );
+		mCanPush = NULL;
+	}
+	if( mCanPop != NULL )
+	{
+		SDL_DestroyCond( mCanPop );
+		mCanPop = NULL;
+	}
+	if( mLock != NULL )
+	{
+		SDL_DestroyMutex( mLock );
+		mLock = NULL;
+	}
+
+	mRing.free();
+}
+
+template<typename T, typename Ring>
+bool LBlockingRing<T, Ring>::push( const T& item )
+{
+	return pushBatch( &item, 1 );
+}
+
+template<typename T, typename Ring>
+bool LBlockingRing<T, Ring>::pushBatch( const T* items, int count )
+{
+	int pushed = 0;
+	int spins = 0;
+	while( pushed < count )
+	{
+		int added = mRing.pushBatch( items + pushed, count - pushed );
+		pushed += added;
+
+		//Let a sleeping consumer at the new items
+		if( added > 0 )
+		{
+			signal( mCanPop, &mPopWaiters );
+			spins = 0;
+		}
+		//Retry a while before sleeping, the consumer is usually right behind
+		else if( ++spins >= RING_SPIN_COUNT && !waitForRoom() )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+template<typename T, typename Ring>
+bool LBlockingRing<T, Ring>::pop( T& item )
+{
+	return popBatch( &item, 1 ) == 1;
+}
+
+template<typename T, typename Ring>
+int LBlockingRing<T, Ring>::popBatch( T* items, int count )
+{
+	int spins = 0;
+	while( true )
+	{
+		int taken = mRing.popBatch( items, count );
+
+		//Let a sleeping producer at the free slots
+		if( taken > 0 )
+		{
+			signal( mCanPush, &mPushWaiters );
+			return taken;
+		}
+
+		//Retry a while before sleeping, the producer is usually right behind
+		if( ++spins >= RING_SPIN_COUNT && !waitForItems() )
+		{
+			return 0;
+		}
+	}
+}
+
+template<typename T, typename Ring>
+bool LBlockingRing<T, Ring>::tryPush( const T& item )
+{
+	bool pushed = mRing.push( item );
+	if( pushed )
+	{
+		signal( mCanPop, &mPopWaiters );
+	}
+
+	return pushed;
+}
+
+template<typename T, typename Ring>
+bool LBlockingRing<T, Ring>::tryPop( T& item )
+{
+	bool popped = mRing.pop( item );
+	if( popped )
+	{
+		signal( mCanPush, &mPushWaiters );
+	}
+
+	return popped;
+}
+
+template<typename T, typename Ring>
+void LBlockingRing<T, Ring>::close()
+{
+	//Wake everyone so they see it
+	SDL_LockMutex( mLock );
+	SDL_AtomicSet( &mClosed, 1 );
+	SDL_CondBroadcast( mCanPush );
+	SDL_CondBroadcast( mCanPop );
+	SDL_UnlockMutex( mLock );
+}
+
+template<typename T, typename Ring>
+bool LBlockingRing<T, Ring>::waitForRoom()
+{
+	//Count ourselves asleep before checking so a consumer can't miss us
+	SDL_LockMutex( mLock );
+	SDL_AtomicIncRef( &mPushWaiters );
+	while( SDL_AtomicGet( &mClosed ) == 0 && mRing.getSize() >= mRing.getCapacity() )
+	{
+		SDL_CondWait( mCanPush, mLock );
+	}
+	SDL_AtomicAdd( &mPushWaiters, -1 );
+	bool open = SDL_AtomicGet( &mClosed ) == 0;
+	SDL_UnlockMutex( mLock );
+
+	return open;
+}
+
+template<typename T, typename Ring>
+bool LBlockingRing<T, Ring>::waitForItems()
+{
+	//Count ourselves asleep before checking so a producer can't miss us
+	SDL_LockMutex( mLock );
+	SDL_AtomicIncRef( &mPopWaiters );
+	while( SDL_AtomicGet( &mClosed ) == 0 && mRing.getSize() == 0 )
+	{
+		SDL_CondWait( mCanPop, mLock );
+	}
+	SDL_AtomicAdd( &mPopWaiters, -1 );
+
+	//Items left after closing can still be taken
+	bool open = SDL_AtomicGet( &mClosed ) == 0 || mRing.getSize() > 0;
+	SDL_UnlockMutex( mLock );
+
+	return open;
+}
+
+template<typename T, typename Ring>
+void LBlockingRing<T, Ring>::signal( SDL_cond* condition, SDL_atomic_t* waiters )
+{
+	//Only touch the lock when someone is asleep
+	if( SDL_AtomicGet( waiters ) > 0 )
+	{
+		SDL_LockMutex( mLock );
+		SDL_CondSignal( condition );
+		SDL_UnlockMutex( mLock );
+	}
+}
+
 bool init()
 {
 	//Initialization flag
@@ -489,16 +1186,16 @@ bool init()
 
 bool loadMedia()
 {
-  //Create the mutex
-  gBufferLock = SDL_CreateMutex();
-
-  //Create conditions
-  gCanProduce = SDL_CreateCond();
-  gCanConsume = SDL_CreateCond();
-
 	//Loading success flag
 	bool success = true;
 
+  //Create the buffer
+  if( !gBuffer.create( BUFFER_CAPACITY ) )
+  {
+    printf( "Failed to create data buffer!\n" );
+    success = false;
+  }
+
 	//Load blank texture
 	if( !gSplashTexture.loadFromFile( "Lesson_48/splash.png" ) )
 	{
@@ -514,15 +1211,8 @@ void close()
 	//Free loaded images
 	gSplashTexture.free();
 
-  //Destroy the mutex
-  SDL_DestroyMutex( gBufferLock );
-  gBufferLock = NULL;
-
-  //Destroy conditions
-  SDL_DestroyCond( gCanProduce );
-  SDL_DestroyCond( gCanConsume );
-  gCanProduce = NULL;
-  gCanConsume = NULL;
+  //Destroy the buffer
+  gBuffer.free();
 
 	//Destroy window
 	SDL_DestroyRenderer( gRenderer );
@@ -580,54 +1270,222 @@ int consumer( void *data )
 
 void produce()
 {
-  //Lock
-  SDL_LockMutex( gBufferLock );
+  //Fill buffer
+  int data = rand() % 256;
 
   //If the buffer is full
-  if( gData != -1 )
+  if( !gBuffer.tryPush( data ) )
   {
     //Wait for buffer to be cleared
     printf( "\nProducer encountered full buffer, waiting for consumer to empty buffer ...\n" );
-    SDL_CondWait( gCanProduce, gBufferLock );
+    gBuffer.push( data );
   }
 
-  //Fill and show buffer
-  gData = rand() % 256;
-  printf( "\nProduced %d\n", gData );
-
-  //Unlock
-  SDL_UnlockMutex( gBufferLock );
-
-  //Signal consumer
-  SDL_CondSignal( gCanConsume );
+  //Show buffer
+  printf( "\nProduced %d\n", data );
 }
 
 void consume()
 {
-  //Lock
-  SDL_LockMutex( gBufferLock );
+  int data = -1;
 
   //If the buffer is empty
-  if( gData == - 1) 
+  if( !gBuffer.tryPop( data ) )
   {
     //Wait for buffer to be filled
     printf( "\nConsumer encountered empty buffer, waiting for producer to fill it ...\n" );
-    SDL_CondWait( gCanConsume, gBufferLock );
+    gBuffer.pop( data );
   }
 
-  //Show and empty buffer
-  printf( "\nConsumed %d\n", gData );
-  gData = -1;
+  //Show buffer
+  printf( "\nConsumed %d\n", data );
+}
+
+//Moves items through a ring for the benchmark
+struct RingBenchmark
+{
+	//The ring under test
+	LBlockingRing< int, LMPMCRing<int> >* ring;
+
+	//Items each producer sends and per call
+	int items;
+	int batch;
+
+	//Sum of what a consumer received
+	long long sum;
+};
+
+int benchmarkProducer( void* data )
+{
+	RingBenchmark* benchmark = static_cast<RingBenchmark*>( data );
+	std::vector<int> items( benchmark->batch );
+	for( int i = 0; i < benchmark->items; i += benchmark->batch )
+	{
+		for( int j = 0; j < benchmark->batch; ++j )
+		{
+			items[ j ] = i + j;
+		}
+		benchmark->ring->pushBatch( &items[ 0 ], benchmark->batch );
+	}
+
+	return 0;
+}
+
+int benchmarkConsumer( void* data )
+{
+	RingBenchmark* benchmark = static_cast<RingBenchmark*>( data );
+	std::vector<int> items( benchmark->batch );
+	int count;
+	while( ( count = benchmark->ring->popBatch( &items[ 0 ], benchmark->batch ) ) > 0 )
+	{
+		for( int j = 0; j < count; ++j )
+		{
+			benchmark->sum += items[ j ];
+		}
+	}
+
+	return 0;
+}
+
+//The old single slot buffer, a lock and signal per item
+struct SlotBenchmark
+{
+	SDL_mutex* lock;
+	SDL_cond* canProduce;
+	SDL_cond* canConsume;
+	int data;
+
+	//Items to move and the sum the consumer received
+	int items;
+	long long sum;
+};
+
+int benchmarkSlotConsumer( void* data )
+{
+	SlotBenchmark* slot = static_cast<SlotBenchmark*>( data );
+	for( int i = 0; i < slot->items; ++i )
+	{
+		SDL_LockMutex( slot->lock );
+		while( slot->data == -1 )
+		{
+			SDL_CondWait( slot->canConsume, slot->lock );
+		}
+		slot->sum += slot->data;
+		slot->data = -1;
+		SDL_UnlockMutex( slot->lock );
+		SDL_CondSignal( slot->canProduce );
+	}
+
+	return 0;
+}
+
+int benchmarkSPSCConsumer( void* data )
+{
+	LBlockingRing< int, LSPSCRing<int> >* ring = static_cast< LBlockingRing< int, LSPSCRing<int> >* >( data );
+	int items[ 64 ];
+	while( ring->popBatch( items, 64 ) > 0 )
+	{
+	}
+
+	return 0;
+}
+
+void benchmarkRings()
+{
+	const int ITEMS = 1 << 20;
+	const int RING_CAPACITY = 1024;
+	const int THREADS = 2;
 
-  //Unlock
-  SDL_UnlockMutex( gBufferLock );
+	//The old single slot buffer for reference, a lock and signal per item
+	SlotBenchmark slot = { SDL_CreateMutex(), SDL_CreateCond(), SDL_CreateCond(), -1, ITEMS, 0 };
 
-  //Signal producer
-  SDL_CondSignal( gCanProduce );
+	Uint64 start = SDL_GetPerformanceCounter();
+	SDL_Thread* slotConsumer = SDL_CreateThread( benchmarkSlotConsumer, "Consumer", &slot );
+	for( int i = 0; i < ITEMS; ++i )
+	{
+		SDL_LockMutex( slot.lock );
+		while( slot.data != -1 )
+		{
+			SDL_CondWait( slot.canProduce, slot.lock );
+		}
+		slot.data = i;
+		SDL_UnlockMutex( slot.lock );
+		SDL_CondSignal( slot.canConsume );
+	}
+	SDL_WaitThread( slotConsumer, NULL );
+	double slotTime = (double)( SDL_GetPerformanceCounter() - start ) / SDL_GetPerformanceFrequency();
+	printf( "Locked slot: %.1f M items/s (sum %lld)\n", ITEMS / slotTime / 1e6, slot.sum );
+	SDL_DestroyCond( slot.canProduce );
+	SDL_DestroyCond( slot.canConsume );
+	SDL_DestroyMutex( slot.lock );
+
+	//Single producer and consumer ring, one item and a batch at a time
+	const int batches[] = { 1, 64 };
+	for( int b = 0; b < 2; ++b )
+	{
+		LBlockingRing< int, LSPSCRing<int> > spsc;
+		spsc.create( RING_CAPACITY );
+
+		start = SDL_GetPerformanceCounter();
+		std::vector<int> items( batches[ b ] );
+		SDL_Thread* consumerThread = SDL_CreateThread( benchmarkSPSCConsumer, "Consumer", &spsc );
+		for( int i = 0; i < ITEMS; i += batches[ b ] )
+		{
+			for( int j = 0; j < batches[ b ]; ++j )
+			{
+				items[ j ] = i + j;
+			}
+			spsc.pushBatch( &items[ 0 ], batches[ b ] );
+		}
+		spsc.close();
+		SDL_WaitThread( consumerThread, NULL );
+		double spscTime = (double)( SDL_GetPerformanceCounter() - start ) / SDL_GetPerformanceFrequency();
+		printf( "SPSC ring, batches of %d: %.1f M items/s\n", batches[ b ], ITEMS / spscTime / 1e6 );
+	}
+
+	//Several producers and consumers on one ring
+	for( int b = 0; b < 2; ++b )
+	{
+		LBlockingRing< int, LMPMCRing<int> > mpmc;
+		mpmc.create( RING_CAPACITY );
+
+		RingBenchmark producers[ THREADS ], consumers[ THREADS ];
+		SDL_Thread* producerThreads[ THREADS ];
+		SDL_Thread* consumerThreads[ THREADS ];
+		start = SDL_GetPerformanceCounter();
+		for( int t = 0; t < THREADS; ++t )
+		{
+			RingBenchmark setup = { &mpmc, ITEMS / THREADS, batches[ b ], 0 };
+			producers[ t ] = setup;
+			consumers[ t ] = setup;
+			consumerThreads[ t ] = SDL_CreateThread( benchmarkConsumer, "Consumer", &consumers[ t ] );
+			producerThreads[ t ] = SDL_CreateThread( benchmarkProducer, "Producer", &producers[ t ] );
+		}
+		for( int t = 0; t < THREADS; ++t )
+		{
+			SDL_WaitThread( producerThreads[ t ], NULL );
+		}
+		mpmc.close();
+		long long sum = 0;
+		for( int t = 0; t < THREADS; ++t )
+		{
+			SDL_WaitThread( consumerThreads[ t ], NULL );
+			sum += consumers[ t ].sum;
+		}
+		double mpmcTime = (double)( SDL_GetPerformanceCounter() - start ) / SDL_GetPerformanceFrequency();
+		printf( "MPMC ring, %d producers and consumers, batches of %d: %.1f M items/s (sum %lld)\n", THREADS, batches[ b ], ITEMS / mpmcTime / 1e6, sum );
+	}
 }
 
 int main( int argc, char* args[] )
 {
+	//Time the buffers without opening a window
+	if( argc > 1 && std::string( args[ 1 ] ) == "--benchmark" )
+	{
+		benchmarkRings();
+		return 0;
+	}
+
 	//Start up SDL and create window
 	if( !init() )
 	{